@@ -1,21 +1,49 @@
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <iomanip>
 #include <memory>
 #include <cstddef>
+#include <cstdint>
 #include <set>
 #include <map>
+#include <unordered_map>
 #include <algorithm>
 #include <cctype>
 #include <cmath>
 #include <limits>
 #include <sstream>
 #include <fstream>
+#include <functional>
+#include <deque>
+#include <thread>
+#include <future>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+#ifndef NDEBUG
+#define EIGEN_RUNTIME_NO_MALLOC
+#endif
 #include "Eigen/Dense"
+#include "Eigen/Sparse"
+#include "Eigen/SparseLU"
 
 using namespace std;
 
+const int SPARSE_MNA_THRESHOLD = 200;
+const int PARALLEL_ASSEMBLY_THRESHOLD = 1 << 18;
+
+using SparseSolver = Eigen::SparseLU<Eigen::SparseMatrix<double>, Eigen::COLAMDOrdering<int>>;
+
 enum class ComponentType {
     RESISTOR,
     CAPACITOR,
@@ -25,6 +53,24 @@ enum class ComponentType {
     UNKNOWN
 };
 
+string componentTypeName(ComponentType type) {
+    switch (type) {
+        case ComponentType::RESISTOR: return "Resistor";
+        case ComponentType::CAPACITOR: return "Capacitor";
+        case ComponentType::INDUCTOR: return "Inductor";
+        case ComponentType::VOLTAGE_SOURCE: return "Voltage Source";
+        case ComponentType::CURRENT_SOURCE: return "Current Source";
+        default: return "Unknown";
+    }
+}
+
+enum class ElementParameter {
+    VALUE,
+    AMPLITUDE,
+    FREQUENCY,
+    INITIAL_CONDITION
+};
+
 class Component {
 protected:
     string name;
@@ -39,225 +85,2482 @@ public:
     virtual string getType() const = 0;
     virtual string serialize() const = 0;
 
-    string getName() const { return name; }
-    void setNodes(int newNode1, int newNode2) {
-        this->node1 = newNode1;
-        this->node2 = newNode2;
+    string getName() const { return name; }
+    void setNodes(int newNode1, int newNode2) {
+        this->node1 = newNode1;
+        this->node2 = newNode2;
+    }
+
+    int getNode1() const { return node1; }
+    int getNode2() const { return node2; }
+};
+
+class Resistor : public Component {
+private:
+    double resistance;
+
+public:
+    Resistor(const string& name, double res, int n1, int n2)
+            : Component(name, n1, n2), resistance(res) {}
+
+    void display() const override {
+        cout << "  - Element: " << name << " | Type: " << getType()
+             << " | Value: " << scientific << setprecision(4) << resistance << " Ohm"
+             << " | Nodes: (" << node1 << ", " << node2 << ")" << endl;
+    }
+    string getType() const override { return "Resistor"; }
+    string serialize() const override {
+        stringstream ss;
+        ss << "Resistor " << name << " " << resistance << " " << node1 << " " << node2;
+        return ss.str();
+    }
+
+    void setResistance(double res) { this->resistance = res; }
+    double getResistance() const { return resistance; }
+};
+
+class Capacitor : public Component {
+private:
+    double capacitance;
+    double initialVoltage = numeric_limits<double>::quiet_NaN();
+
+public:
+    Capacitor(const string& name, double cap, int n1, int n2)
+            : Component(name, n1, n2), capacitance(cap) {}
+
+    void display() const override {
+        cout << "  - Element: " << name << " | Type: " << getType() << " | Value: " << scientific << setprecision(4) << capacitance << " F";
+        if (hasInitialCondition()) cout << " | IC: " << scientific << setprecision(4) << initialVoltage << " V";
+        cout << " | Nodes: (" << node1 << ", " << node2 << ")" << endl;
+    }
+    string getType() const override { return "Capacitor"; }
+    string serialize() const override {
+        stringstream ss;
+        ss << "Capacitor " << name << " " << capacitance << " " << node1 << " " << node2;
+        if (hasInitialCondition()) ss << " IC=" << initialVoltage;
+        return ss.str();
+    }
+
+    void setCapacitance(double cap) { this->capacitance = cap; }
+    double getCapacitance() const { return capacitance; }
+    // Voltage from node1 to node2 at the start of a transient run that begins
+    // at the operating point; NaN for none.
+    void setInitialCondition(double voltage) { this->initialVoltage = voltage; }
+    double getInitialCondition() const { return initialVoltage; }
+    bool hasInitialCondition() const { return !isnan(initialVoltage); }
+};
+
+class Inductor : public Component {
+private:
+    double inductance;
+    double initialCurrent = numeric_limits<double>::quiet_NaN();
+
+public:
+    Inductor(const string& name, double ind, int n1, int n2)
+            : Component(name, n1, n2), inductance(ind) {}
+
+    void display() const override {
+        cout << "  - Element: " << name << " | Type: " << getType() << " | Value: " << scientific << setprecision(4) << inductance << " H";
+        if (hasInitialCondition()) cout << " | IC: " << scientific << setprecision(4) << initialCurrent << " A";
+        cout << " | Nodes: (" << node1 << ", " << node2 << ")" << endl;
+    }
+    string getType() const override { return "Inductor"; }
+    string serialize() const override {
+        stringstream ss;
+        ss << "Inductor " << name << " " << inductance << " " << node1 << " " << node2;
+        if (hasInitialCondition()) ss << " IC=" << initialCurrent;
+        return ss.str();
+    }
+
+    void setInductance(double ind) { this->inductance = ind; }
+    double getInductance() const { return inductance; }
+    // Current from node1 to node2 at the start of a transient run that begins
+    // at the operating point; NaN for none.
+    void setInitialCondition(double current) { this->initialCurrent = current; }
+    double getInitialCondition() const { return initialCurrent; }
+    bool hasInitialCondition() const { return !isnan(initialCurrent); }
+};
+
+struct SourceStamp;
+
+class VoltageSource : public Component {
+public:
+    enum class Waveform { DC, SINE };
+private:
+    Waveform waveformType;
+    double offset_or_dc_value;
+    double amplitude;
+    double frequency;
+
+public:
+    VoltageSource(const string& name, double dc_val, int n1, int n2)
+            : Component(name, n1, n2), waveformType(Waveform::DC), offset_or_dc_value(dc_val),
+              amplitude(0), frequency(0) {}
+
+    VoltageSource(const string& name, double offset, double amp, double freq, int n1, int n2)
+            : Component(name, n1, n2), waveformType(Waveform::SINE), offset_or_dc_value(offset),
+              amplitude(amp), frequency(freq) {}
+
+    double getValueAtTime(double time) const {
+        if (waveformType == Waveform::SINE) return offset_or_dc_value + amplitude * sin(2 * M_PI * frequency * time);
+        return offset_or_dc_value;
+    }
+
+    void display() const override {
+        cout << "  - Element: " << name << " | Type: " << getType();
+        if (waveformType == Waveform::DC) {
+            cout << " (DC) | Value: " << scientific << setprecision(4) << offset_or_dc_value << " V";
+        } else {
+            cout << " (SINE) | Params: Offset=" << scientific << setprecision(4) << offset_or_dc_value << ", Amp=" << scientific << setprecision(4) << amplitude << ", Freq=" << scientific << setprecision(4) << frequency << "Hz";
+        }
+        cout << " | Nodes: (" << node1 << ", " << node2 << ")" << endl;
+    }
+
+    string getType() const override { return "Voltage Source"; }
+    string serialize() const override {
+        stringstream ss;
+        ss << "VoltageSource " << name << " " << (waveformType == Waveform::DC ? "DC" : "SINE") << " "
+           << offset_or_dc_value << " " << amplitude << " " << frequency << " " << node1 << " " << node2;
+        return ss.str();
+    }
+
+    Waveform getWaveformType() const { return waveformType; }
+    void setDCOffsetValue(double val) { this->offset_or_dc_value = val; }
+    double getDCOffsetValue() const { return offset_or_dc_value; }
+    void setAmplitude(double amp) { this->amplitude = amp; }
+    double getAmplitude() const { return amplitude; }
+    void setFrequency(double freq) { this->frequency = freq; }
+    double getFrequency() const { return frequency; }
+
+    // First waveform breakpoint strictly after `time`, and the longest step
+    // that still resolves the waveform; infinity for DC. Both use the rules of
+    // the SourceStamp that the stepper reads.
+    double nextBreakpoint(double time) const;
+    double maxSafeStep() const;
+
+private:
+    SourceStamp waveformStamp() const;
+};
+
+class CurrentSource : public Component {
+public:
+    enum class Waveform { DC, SINE };
+private:
+    Waveform waveformType;
+    double offset_or_dc_value;
+    double amplitude;
+    double frequency;
+
+public:
+    CurrentSource(const string& name, double dc_val, int n1, int n2)
+            : Component(name, n1, n2), waveformType(Waveform::DC), offset_or_dc_value(dc_val),
+              amplitude(0), frequency(0) {}
+
+    CurrentSource(const string& name, double offset, double amp, double freq, int n1, int n2)
+            : Component(name, n1, n2), waveformType(Waveform::SINE), offset_or_dc_value(offset),
+              amplitude(amp), frequency(freq) {}
+
+    double getValueAtTime(double time) const {
+        if (waveformType == Waveform::SINE) return offset_or_dc_value + amplitude * sin(2 * M_PI * frequency * time);
+        return offset_or_dc_value;
+    }
+
+    void display() const override {
+        cout << "  - Element: " << name << " | Type: " << getType();
+        if (waveformType == Waveform::DC) {
+            cout << " (DC) | Value: " << scientific << setprecision(4) << offset_or_dc_value << " A";
+        } else {
+            cout << " (SINE) | Params: Offset=" << scientific << setprecision(4) << offset_or_dc_value << ", Amp=" << scientific << setprecision(4) << amplitude << ", Freq=" << scientific << setprecision(4) << frequency << "Hz";
+        }
+        cout << " | Nodes: (" << node1 << ", " << node2 << ")" << endl;
+    }
+
+    string getType() const override { return "Current Source"; }
+    string serialize() const override {
+        stringstream ss;
+        ss << "CurrentSource " << name << " " << (waveformType == Waveform::DC ? "DC" : "SINE") << " "
+           << offset_or_dc_value << " " << amplitude << " " << frequency << " " << node1 << " " << node2;
+        return ss.str();
+    }
+
+    Waveform getWaveformType() const { return waveformType; }
+    void setDCOffsetValue(double val) { this->offset_or_dc_value = val; }
+    double getDCOffsetValue() const { return offset_or_dc_value; }
+    void setAmplitude(double amp) { this->amplitude = amp; }
+    double getAmplitude() const { return amplitude; }
+    void setFrequency(double freq) { this->frequency = freq; }
+    double getFrequency() const { return frequency; }
+
+    // First waveform breakpoint strictly after `time`, and the longest step
+    // that still resolves the waveform; infinity for DC. Both use the rules of
+    // the SourceStamp that the stepper reads.
+    double nextBreakpoint(double time) const;
+    double maxSafeStep() const;
+
+private:
+    SourceStamp waveformStamp() const;
+};
+
+// Component names interned into one character buffer. Ids are handed out in
+// insertion order; find() returns the first id registered under a name.
+class NameTable {
+private:
+    string characters;
+    vector<uint32_t> offsets = {0};
+    vector<int> buckets = vector<int>(16, -1);
+
+    size_t bucketFor(string_view key) const {
+        size_t mask = buckets.size() - 1;
+        size_t i = hash<string_view>()(key) & mask;
+        while (buckets[i] != -1 && name(buckets[i]) != key) {
+            i = (i + 1) & mask;
+        }
+        return i;
+    }
+
+    void rehash(size_t bucketCount) {
+        buckets.assign(bucketCount, -1);
+        for (int id = 0; id < size(); ++id) {
+            size_t slot = bucketFor(name(id));
+            if (buckets[slot] == -1) buckets[slot] = id;
+        }
+    }
+
+public:
+    int size() const { return (int)offsets.size() - 1; }
+
+    string_view name(int id) const {
+        return string_view(characters).substr(offsets[id], offsets[id + 1] - offsets[id]);
+    }
+
+    int find(string_view key) const { return buckets[bucketFor(key)]; }
+
+    int add(string_view key) {
+        if (2 * (size_t)(size() + 1) > buckets.size()) rehash(2 * buckets.size());
+        int id = size();
+        characters.append(key);
+        offsets.push_back(characters.size());
+        size_t slot = bucketFor(key);
+        if (buckets[slot] == -1) buckets[slot] = id;
+        return id;
+    }
+
+    // Later ids move down by one.
+    void remove(int id) {
+        uint32_t begin = offsets[id];
+        uint32_t length = offsets[id + 1] - begin;
+        characters.erase(begin, length);
+        offsets.erase(offsets.begin() + id + 1);
+        for (size_t k = id + 1; k < offsets.size(); ++k) offsets[k] -= length;
+        rehash(buckets.size());
+    }
+
+    void reserve(size_t count, size_t totalLength) {
+        characters.reserve(totalLength);
+        offsets.reserve(count + 1);
+        size_t bucketCount = buckets.size();
+        while (bucketCount < 2 * (count + 1)) bucketCount *= 2;
+        if (bucketCount != buckets.size()) rehash(bucketCount);
+    }
+};
+
+struct PassiveArrays {
+    vector<int> id;
+    vector<int> node1;
+    vector<int> node2;
+    vector<double> value;
+    // Capacitor voltage or inductor current at t = 0; NaN when unset and for
+    // resistors.
+    vector<double> initialCondition;
+
+    size_t size() const { return id.size(); }
+    void push(int elementId, int n1, int n2, double elementValue,
+              double elementInitialCondition = numeric_limits<double>::quiet_NaN()) {
+        id.push_back(elementId);
+        node1.push_back(n1);
+        node2.push_back(n2);
+        value.push_back(elementValue);
+        initialCondition.push_back(elementInitialCondition);
+    }
+    void erase(size_t pos) {
+        id.erase(id.begin() + pos);
+        node1.erase(node1.begin() + pos);
+        node2.erase(node2.begin() + pos);
+        value.erase(value.begin() + pos);
+        initialCondition.erase(initialCondition.begin() + pos);
+    }
+};
+
+struct SourceArrays {
+    vector<int> id;
+    vector<int> node1;
+    vector<int> node2;
+    vector<unsigned char> sine;
+    vector<double> offset;
+    vector<double> amplitude;
+    vector<double> frequency;
+
+    size_t size() const { return id.size(); }
+    void push(int elementId, int n1, int n2, bool isSine, double dcOffset, double amp, double freq) {
+        id.push_back(elementId);
+        node1.push_back(n1);
+        node2.push_back(n2);
+        sine.push_back(isSine);
+        offset.push_back(dcOffset);
+        amplitude.push_back(isSine ? amp : 0.0);
+        frequency.push_back(isSine ? freq : 0.0);
+    }
+    void erase(size_t pos) {
+        id.erase(id.begin() + pos);
+        node1.erase(node1.begin() + pos);
+        node2.erase(node2.begin() + pos);
+        sine.erase(sine.begin() + pos);
+        offset.erase(offset.begin() + pos);
+        amplitude.erase(amplitude.begin() + pos);
+        frequency.erase(frequency.begin() + pos);
+    }
+};
+
+// Structure-of-arrays store of a circuit's elements, the only form in which
+// a Circuit keeps them. An element id is its insertion position and indexes
+// `names`, `types` and `positions`; `positions` locates the element inside the
+// arrays of its type. Component objects are built from it on demand, for
+// display, saving and the interactive menus.
+//
+// Per-element storage (64-bit, ignoring vector growth slack):
+//   R, C, L:  id + 2 nodes + value + initial condition   = 28 bytes
+//   V, I:     id + 2 nodes + sine flag + 3 doubles       = 37 bytes
+//   all:      type + position + name offset              = 12 bytes
+//             + name characters + 8-16 bytes of hash buckets (load <= 0.5)
+// A 2M-element RC netlist with 8-character names measured about 140 MB
+// including growth slack, where one heap-allocated Component object per
+// element took about 160 MB.
+class CompactNetlist {
+public:
+    NameTable names;
+    vector<ComponentType> types;
+    vector<int> positions;
+    PassiveArrays resistors;
+    PassiveArrays capacitors;
+    PassiveArrays inductors;
+    SourceArrays voltageSources;
+    SourceArrays currentSources;
+
+    int size() const { return (int)types.size(); }
+    int find(string_view name) const { return names.find(name); }
+    int node1Of(int id) const;
+    int node2Of(int id) const;
+    // Returns the new element's id.
+    int add(const Component& element);
+    // Later ids move down by one.
+    void remove(int id);
+    unique_ptr<Component> element(int id) const;
+    void setNodes(int id, int n1, int n2);
+    void renameNode(int oldNode, int newNode);
+    // False if the element has no such parameter; NaN clears an initial
+    // condition.
+    bool setParameter(int id, ElementParameter parameter, double value);
+
+private:
+    PassiveArrays* passiveArrays(ComponentType type);
+    SourceArrays* sourceArrays(ComponentType type);
+};
+
+int CompactNetlist::add(const Component& element) {
+    int id = names.add(element.getName());
+    int n1 = element.getNode1();
+    int n2 = element.getNode2();
+    if (auto r = dynamic_cast<const Resistor*>(&element)) {
+        types.push_back(ComponentType::RESISTOR);
+        positions.push_back(resistors.size());
+        resistors.push(id, n1, n2, r->getResistance());
+    } else if (auto c = dynamic_cast<const Capacitor*>(&element)) {
+        types.push_back(ComponentType::CAPACITOR);
+        positions.push_back(capacitors.size());
+        capacitors.push(id, n1, n2, c->getCapacitance(), c->getInitialCondition());
+    } else if (auto l = dynamic_cast<const Inductor*>(&element)) {
+        types.push_back(ComponentType::INDUCTOR);
+        positions.push_back(inductors.size());
+        inductors.push(id, n1, n2, l->getInductance(), l->getInitialCondition());
+    } else if (auto vs = dynamic_cast<const VoltageSource*>(&element)) {
+        types.push_back(ComponentType::VOLTAGE_SOURCE);
+        positions.push_back(voltageSources.size());
+        voltageSources.push(id, n1, n2, vs->getWaveformType() == VoltageSource::Waveform::SINE,
+                            vs->getDCOffsetValue(), vs->getAmplitude(), vs->getFrequency());
+    } else if (auto cs = dynamic_cast<const CurrentSource*>(&element)) {
+        types.push_back(ComponentType::CURRENT_SOURCE);
+        positions.push_back(currentSources.size());
+        currentSources.push(id, n1, n2, cs->getWaveformType() == CurrentSource::Waveform::SINE,
+                            cs->getDCOffsetValue(), cs->getAmplitude(), cs->getFrequency());
+    } else {
+        types.push_back(ComponentType::UNKNOWN);
+        positions.push_back(-1);
+    }
+    return id;
+}
+
+void CompactNetlist::remove(int id) {
+    ComponentType type = types[id];
+    int pos = positions[id];
+    if (PassiveArrays* arrays = passiveArrays(type)) arrays->erase(pos);
+    else if (SourceArrays* arrays = sourceArrays(type)) arrays->erase(pos);
+    types.erase(types.begin() + id);
+    positions.erase(positions.begin() + id);
+    // Elements of one type sit in their arrays in id order, so only later ids
+    // can have moved.
+    for (int other = id; other < size(); ++other) {
+        if (types[other] == type && positions[other] > pos) --positions[other];
+    }
+    auto renumber = [id](vector<int>& ids) {
+        for (int& other : ids) {
+            if (other > id) --other;
+        }
+    };
+    for (PassiveArrays* arrays : {&resistors, &capacitors, &inductors}) renumber(arrays->id);
+    for (SourceArrays* arrays : {&voltageSources, &currentSources}) renumber(arrays->id);
+    names.remove(id);
+}
+
+unique_ptr<Component> CompactNetlist::element(int id) const {
+    string name(names.name(id));
+    int pos = positions[id];
+    switch (types[id]) {
+        case ComponentType::RESISTOR:
+            return make_unique<Resistor>(name, resistors.value[pos], resistors.node1[pos], resistors.node2[pos]);
+        case ComponentType::CAPACITOR: {
+            auto capacitor = make_unique<Capacitor>(name, capacitors.value[pos], capacitors.node1[pos], capacitors.node2[pos]);
+            capacitor->setInitialCondition(capacitors.initialCondition[pos]);
+            return capacitor;
+        }
+        case ComponentType::INDUCTOR: {
+            auto inductor = make_unique<Inductor>(name, inductors.value[pos], inductors.node1[pos], inductors.node2[pos]);
+            inductor->setInitialCondition(inductors.initialCondition[pos]);
+            return inductor;
+        }
+        case ComponentType::VOLTAGE_SOURCE: {
+            const SourceArrays& vs = voltageSources;
+            if (vs.sine[pos]) {
+                return make_unique<VoltageSource>(name, vs.offset[pos], vs.amplitude[pos], vs.frequency[pos], vs.node1[pos], vs.node2[pos]);
+            }
+            return make_unique<VoltageSource>(name, vs.offset[pos], vs.node1[pos], vs.node2[pos]);
+        }
+        case ComponentType::CURRENT_SOURCE: {
+            const SourceArrays& cs = currentSources;
+            if (cs.sine[pos]) {
+                return make_unique<CurrentSource>(name, cs.offset[pos], cs.amplitude[pos], cs.frequency[pos], cs.node1[pos], cs.node2[pos]);
+            }
+            return make_unique<CurrentSource>(name, cs.offset[pos], cs.node1[pos], cs.node2[pos]);
+        }
+        default:
+            return nullptr;
+    }
+}
+
+void CompactNetlist::setNodes(int id, int n1, int n2) {
+    int pos = positions[id];
+    if (PassiveArrays* arrays = passiveArrays(types[id])) {
+        arrays->node1[pos] = n1;
+        arrays->node2[pos] = n2;
+    } else if (SourceArrays* arrays = sourceArrays(types[id])) {
+        arrays->node1[pos] = n1;
+        arrays->node2[pos] = n2;
+    }
+}
+
+void CompactNetlist::renameNode(int oldNode, int newNode) {
+    auto rename = [oldNode, newNode](vector<int>& nodes) { replace(nodes.begin(), nodes.end(), oldNode, newNode); };
+    for (PassiveArrays* arrays : {&resistors, &capacitors, &inductors}) {
+        rename(arrays->node1);
+        rename(arrays->node2);
+    }
+    for (SourceArrays* arrays : {&voltageSources, &currentSources}) {
+        rename(arrays->node1);
+        rename(arrays->node2);
+    }
+}
+
+bool CompactNetlist::setParameter(int id, ElementParameter parameter, double value) {
+    int pos = positions[id];
+    PassiveArrays* passive = passiveArrays(types[id]);
+    SourceArrays* source = sourceArrays(types[id]);
+    switch (parameter) {
+        case ElementParameter::VALUE:
+            if (passive) passive->value[pos] = value;
+            else if (source) source->offset[pos] = value;
+            else return false;
+            return true;
+        case ElementParameter::AMPLITUDE:
+        case ElementParameter::FREQUENCY:
+            // A DC source keeps zero amplitude and frequency.
+            if (!source) return false;
+            if (source->sine[pos]) (parameter == ElementParameter::AMPLITUDE ? source->amplitude : source->frequency)[pos] = value;
+            return true;
+        case ElementParameter::INITIAL_CONDITION:
+            if (types[id] != ComponentType::CAPACITOR && types[id] != ComponentType::INDUCTOR) return false;
+            passive->initialCondition[pos] = value;
+            return true;
+        default:
+            return false;
+    }
+}
+
+PassiveArrays* CompactNetlist::passiveArrays(ComponentType type) {
+    switch (type) {
+        case ComponentType::RESISTOR: return &resistors;
+        case ComponentType::CAPACITOR: return &capacitors;
+        case ComponentType::INDUCTOR: return &inductors;
+        default: return nullptr;
+    }
+}
+
+SourceArrays* CompactNetlist::sourceArrays(ComponentType type) {
+    switch (type) {
+        case ComponentType::VOLTAGE_SOURCE: return &voltageSources;
+        case ComponentType::CURRENT_SOURCE: return &currentSources;
+        default: return nullptr;
+    }
+}
+
+int CompactNetlist::node1Of(int id) const {
+    int pos = positions[id];
+    switch (types[id]) {
+        case ComponentType::RESISTOR: return resistors.node1[pos];
+        case ComponentType::CAPACITOR: return capacitors.node1[pos];
+        case ComponentType::INDUCTOR: return inductors.node1[pos];
+        case ComponentType::VOLTAGE_SOURCE: return voltageSources.node1[pos];
+        case ComponentType::CURRENT_SOURCE: return currentSources.node1[pos];
+        default: return 0;
+    }
+}
+
+int CompactNetlist::node2Of(int id) const {
+    int pos = positions[id];
+    switch (types[id]) {
+        case ComponentType::RESISTOR: return resistors.node2[pos];
+        case ComponentType::CAPACITOR: return capacitors.node2[pos];
+        case ComponentType::INDUCTOR: return inductors.node2[pos];
+        case ComponentType::VOLTAGE_SOURCE: return voltageSources.node2[pos];
+        case ComponentType::CURRENT_SOURCE: return currentSources.node2[pos];
+        default: return 0;
+    }
+}
+
+// Dense numbering of the non-ground nodes, kept up to date as elements are
+// added, removed or reconnected. When a node loses its last reference the
+// last node takes over its index, so indices always stay contiguous.
+class NodeNumbering {
+private:
+    unordered_map<int, int> indices;
+    vector<int> nodeNumbers;
+    vector<int> references;
+    int groundReferences = 0;
+
+    int insert(int node, int count) {
+        int idx = nodeNumbers.size();
+        indices.emplace(node, idx);
+        nodeNumbers.push_back(node);
+        references.push_back(count);
+        return idx;
+    }
+
+    void erase(int idx) {
+        int node = nodeNumbers[idx];
+        int last = (int)nodeNumbers.size() - 1;
+        nodeNumbers[idx] = nodeNumbers[last];
+        references[idx] = references[last];
+        indices[nodeNumbers[idx]] = idx;
+        nodeNumbers.pop_back();
+        references.pop_back();
+        indices.erase(node);
+    }
+
+public:
+    void addReference(int node) {
+        if (node == 0) {
+            groundReferences++;
+            return;
+        }
+        auto it = indices.find(node);
+        if (it == indices.end()) insert(node, 1);
+        else references[it->second]++;
+    }
+
+    void removeReference(int node) {
+        if (node == 0) {
+            groundReferences--;
+            return;
+        }
+        auto it = indices.find(node);
+        if (it == indices.end()) return;
+        if (--references[it->second] == 0) erase(it->second);
+    }
+
+    void rename(int oldNode, int newNode) {
+        if (oldNode == newNode || !contains(oldNode) || contains(newNode)) return;
+        if (oldNode == 0) {
+            insert(newNode, groundReferences);
+            groundReferences = 0;
+        } else if (newNode == 0) {
+            int idx = indices.at(oldNode);
+            groundReferences = references[idx];
+            erase(idx);
+        } else {
+            int idx = indices.at(oldNode);
+            indices.erase(oldNode);
+            indices.emplace(newNode, idx);
+            nodeNumbers[idx] = newNode;
+        }
+    }
+
+    void clear() {
+        indices.clear();
+        nodeNumbers.clear();
+        references.clear();
+        groundReferences = 0;
+    }
+
+    bool contains(int node) const { return node == 0 ? groundReferences > 0 : indices.count(node) > 0; }
+    bool hasGround() const { return groundReferences > 0; }
+    int indexOf(int node) const {
+        auto it = indices.find(node);
+        return it == indices.end() ? -1 : it->second;
+    }
+    int size() const { return nodeNumbers.size(); }
+    const vector<int>& getNodeNumbers() const { return nodeNumbers; }
+};
+
+int findSingularPivot(const Eigen::MatrixXd& matrix, const Eigen::PartialPivLU<Eigen::MatrixXd>& lu) {
+    const Eigen::MatrixXd& factors = lu.matrixLU();
+    for (int k = 0; k < factors.rows(); ++k) {
+        double columnScale = matrix.col(k).cwiseAbs().maxCoeff();
+        double tolerance = columnScale * numeric_limits<double>::epsilon() * factors.rows();
+        if (abs(factors(k, k)) <= tolerance) {
+            return k;
+        }
+    }
+    return -1;
+}
+
+// Pivot of column `j`, in the solver's column order, of a successful SparseLU
+// factorization. U is upper triangular, so entry j of U^-1 e_j is 1 / U(j, j).
+double sparseLUPivot(const SparseSolver& solver, int j, Eigen::VectorXd& work) {
+    work.setZero();
+    work(j) = 1.0;
+    solver.matrixU().solveInPlace(work);
+    return 1.0 / work(j);
+}
+
+// The sparse pivots are checked against the same relative tolerance as the
+// dense path, without a second factorization. One solve with a fixed
+// pseudo-random right-hand side screens for a near-singular matrix: a pivot
+// at the tolerance makes |A| |x| / |b| at least about 1 / (eps n). Only then
+// are the pivots read one by one, each at the cost of a solve with U. An
+// exactly zero pivot stops SparseLU early, and lastErrorMessage() ends with
+// its column, counted from 1 in the solver's column order.
+int findSingularPivot(const Eigen::SparseMatrix<double>& matrix, const SparseSolver& solver) {
+    int n = matrix.cols();
+    const auto& columnOrder = solver.colsPermutation().indices();
+    if (solver.info() != Eigen::Success) {
+        string message = solver.lastErrorMessage();
+        size_t digits = message.find_last_not_of("0123456789") + 1;
+        if (digits >= message.size()) return -1;
+        int j = stoi(message.substr(digits)) - 1;
+        for (int k = 0; k < columnOrder.size(); ++k) {
+            if (columnOrder(k) == j) return k;
+        }
+        return -1;
+    }
+
+    Eigen::VectorXd b(n);
+    uint32_t state = 12345;
+    for (int i = 0; i < n; ++i) {
+        state = state * 1664525u + 1013904223u;
+        b(i) = 1.0 + (state >> 8) / double(1 << 24);
+    }
+    Eigen::VectorXd x = solver.solve(b);
+    Eigen::VectorXd rowSums = Eigen::VectorXd::Zero(n);
+    for (int k = 0; k < n; ++k) {
+        for (Eigen::SparseMatrix<double>::InnerIterator it(matrix, k); it; ++it) rowSums(it.row()) += abs(it.value());
+    }
+    double estimate = rowSums.maxCoeff() * x.lpNorm<Eigen::Infinity>() / b.lpNorm<Eigen::Infinity>();
+    double epsilon = numeric_limits<double>::epsilon();
+    if (x.allFinite() && estimate * epsilon * n < 1e-2) return -1;
+
+    Eigen::VectorXd work(n);
+    for (int k = 0; k < n; ++k) {
+        double columnScale = 0.0;
+        for (Eigen::SparseMatrix<double>::InnerIterator it(matrix, k); it; ++it) {
+            columnScale = max(columnScale, abs(it.value()));
+        }
+        double pivot = sparseLUPivot(solver, columnOrder(k), work);
+        if (abs(pivot) <= columnScale * epsilon * n) {
+            return k;
+        }
+    }
+    return -1;
+}
+
+void reportSingularMatrix(const string& location, ostream& out = cout) {
+    out << "Error: Circuit matrix is singular";
+    if (!location.empty()) out << " at " << location;
+    out << ". Cannot be solved. Check for floating nodes or invalid connections." << endl;
+}
+
+const double CAPACITOR_GMIN = 1e-12;
+// Conductance (S) that holds a capacitor at its initial voltage, and series
+// resistance (Ohm) that holds an inductor at its initial current, while the
+// operating point is solved.
+const double INITIAL_CONDITION_STIFFNESS = 1e9;
+
+// MNA unknowns are laid out as [non-ground nodes | inductor branch currents |
+// voltage source branch currents]. Work vectors carry one extra trailing entry
+// (groundIndex()) that stands in for node 0, so stamps touching ground need no
+// branches: it reads as zero in the solution and is discarded in the RHS.
+struct MatrixStamp {
+    int row;
+    int col;
+    int slot;
+    double sign;
+};
+
+struct ConductanceStamp {
+    int a;
+    int b;
+    int slot;
+    int component;
+};
+
+struct BranchStamp {
+    int branch;
+    int slot;
+    int component;
+    int a;
+    int b;
+};
+
+// A sine source offset + amplitude * sin(2 pi f t) has its peaks and troughs
+// at f t = 1/4 + k/2. Step control lands on these breakpoints and takes no
+// step longer than 1/SINE_STEPS_PER_PERIOD of a period between them. A DC
+// source has neither, so both return infinity.
+const int SINE_STEPS_PER_PERIOD = 8;
+
+struct SourceStamp {
+    int plus;
+    int minus;
+    double offset;
+    double amplitude;
+    double frequency;
+    int component;
+
+    double nextBreakpoint(double time) const {
+        if (amplitude == 0 || frequency <= 0) return numeric_limits<double>::infinity();
+        // The slack keeps a time that landed on a breakpoint from returning it again.
+        double k = floor(2 * frequency * time - 0.5 + 1e-9) + 1;
+        return (0.25 + 0.5 * k) / frequency;
+    }
+    double maxSafeStep() const {
+        if (amplitude == 0 || frequency <= 0) return numeric_limits<double>::infinity();
+        return 1.0 / (SINE_STEPS_PER_PERIOD * frequency);
+    }
+};
+
+SourceStamp VoltageSource::waveformStamp() const {
+    return {-1, -1, offset_or_dc_value, waveformType == Waveform::SINE ? amplitude : 0.0, frequency, -1};
+}
+double VoltageSource::nextBreakpoint(double time) const { return waveformStamp().nextBreakpoint(time); }
+double VoltageSource::maxSafeStep() const { return waveformStamp().maxSafeStep(); }
+
+SourceStamp CurrentSource::waveformStamp() const {
+    return {-1, -1, offset_or_dc_value, waveformType == Waveform::SINE ? amplitude : 0.0, frequency, -1};
+}
+double CurrentSource::nextBreakpoint(double time) const { return waveformStamp().nextBreakpoint(time); }
+double CurrentSource::maxSafeStep() const { return waveformStamp().maxSafeStep(); }
+
+class StampProgram {
+public:
+    int nodeCount = 0;
+    int inductorCount = 0;
+    int voltageSourceCount = 0;
+    vector<int> nodeNumbers;
+
+    vector<MatrixStamp> matrixStamps;
+    vector<ConductanceStamp> resistors;
+    vector<ConductanceStamp> capacitors;
+    vector<BranchStamp> inductors;
+    vector<BranchStamp> voltageSources;
+    vector<SourceStamp> sourceStamps;
+    vector<double> elementValues;
+    vector<pair<int, double>> initialConditions;
+
+    static StampProgram compile(const CompactNetlist& netlist, const NodeNumbering& numbering);
+
+    int size() const { return nodeCount + inductorCount + voltageSourceCount; }
+    int groundIndex() const { return size(); }
+    // Companion coefficient of `slot` for `value` at the given companion step
+    // (0 = DC).
+    double coefficientFor(int slot, double value, double timeStep) const;
+    string describeUnknown(int idx, const NameTable& names) const;
+};
+
+StampProgram StampProgram::compile(const CompactNetlist& netlist, const NodeNumbering& numbering) {
+    StampProgram program;
+    program.nodeCount = numbering.size();
+    program.nodeNumbers = numbering.getNodeNumbers();
+    program.inductorCount = netlist.inductors.size();
+    program.voltageSourceCount = netlist.voltageSources.size();
+
+    int ground = program.groundIndex();
+    auto indexOf = [&](int node) { return node == 0 ? ground : numbering.indexOf(node); };
+    auto stamp = [&](int row, int col, int slot, double sign) {
+        if (row != ground && col != ground) program.matrixStamps.push_back({row, col, slot, sign});
+    };
+    auto stampConductance = [&](int a, int b, int slot) {
+        stamp(a, a, slot, 1.0);
+        stamp(b, b, slot, 1.0);
+        stamp(a, b, slot, -1.0);
+        stamp(b, a, slot, -1.0);
+    };
+    auto stampIncidence = [&](int a, int b, int branch) {
+        stamp(a, branch, 0, 1.0);
+        stamp(b, branch, 0, -1.0);
+        stamp(branch, a, 0, 1.0);
+        stamp(branch, b, 0, -1.0);
+    };
+
+    // Slot 0 is the constant 1.0 used by branch incidence entries.
+    program.elementValues.push_back(1.0);
+    for (size_t k = 0; k < netlist.resistors.size(); ++k) {
+        int a = indexOf(netlist.resistors.node1[k]);
+        int b = indexOf(netlist.resistors.node2[k]);
+        int slot = program.elementValues.size();
+        program.elementValues.push_back(netlist.resistors.value[k]);
+        program.resistors.push_back({a, b, slot, netlist.resistors.id[k]});
+        stampConductance(a, b, slot);
+    }
+    for (size_t k = 0; k < netlist.capacitors.size(); ++k) {
+        int a = indexOf(netlist.capacitors.node1[k]);
+        int b = indexOf(netlist.capacitors.node2[k]);
+        int slot = program.elementValues.size();
+        program.elementValues.push_back(netlist.capacitors.value[k]);
+        program.capacitors.push_back({a, b, slot, netlist.capacitors.id[k]});
+        stampConductance(a, b, slot);
+    }
+    for (size_t k = 0; k < netlist.inductors.size(); ++k) {
+        int branch = program.nodeCount + k;
+        int slot = program.elementValues.size();
+        program.elementValues.push_back(netlist.inductors.value[k]);
+        int a = indexOf(netlist.inductors.node1[k]);
+        int b = indexOf(netlist.inductors.node2[k]);
+        program.inductors.push_back({branch, slot, netlist.inductors.id[k], a, b});
+        stampIncidence(a, b, branch);
+        stamp(branch, branch, slot, 1.0);
+    }
+    const SourceArrays& vsrc = netlist.voltageSources;
+    for (size_t k = 0; k < vsrc.size(); ++k) {
+        int branch = program.nodeCount + program.inductorCount + k;
+        int a = indexOf(vsrc.node1[k]);
+        int b = indexOf(vsrc.node2[k]);
+        program.voltageSources.push_back({branch, 0, vsrc.id[k], a, b});
+        program.sourceStamps.push_back({branch, ground, vsrc.offset[k], vsrc.amplitude[k], vsrc.frequency[k], vsrc.id[k]});
+        stampIncidence(a, b, branch);
+    }
+    const SourceArrays& isrc = netlist.currentSources;
+    for (size_t k = 0; k < isrc.size(); ++k) {
+        program.sourceStamps.push_back({indexOf(isrc.node2[k]), indexOf(isrc.node1[k]), isrc.offset[k],
+                                        isrc.amplitude[k], isrc.frequency[k], isrc.id[k]});
+    }
+    for (const PassiveArrays* arrays : {&netlist.capacitors, &netlist.inductors}) {
+        for (size_t k = 0; k < arrays->size(); ++k) {
+            if (!isnan(arrays->initialCondition[k])) program.initialConditions.emplace_back(arrays->id[k], arrays->initialCondition[k]);
+        }
+    }
+    return program;
+}
+
+// Slots are numbered resistors first, then capacitors, then inductors. For C
+// and L, `timeStep` is the companion step of the integration method.
+double StampProgram::coefficientFor(int slot, double value, double timeStep) const {
+    int firstCapacitor = 1 + resistors.size();
+    int firstInductor = firstCapacitor + capacitors.size();
+    if (slot == 0) return 1.0;
+    if (slot < firstCapacitor) return 1.0 / value;
+    if (slot < firstInductor) return (timeStep > 0 && value > 0) ? value / timeStep : CAPACITOR_GMIN;
+    return timeStep > 0 ? -value / timeStep : 0.0;
+}
+
+string StampProgram::describeUnknown(int idx, const NameTable& names) const {
+    if (idx < 0 || idx >= size()) return "";
+    if (idx < nodeCount) return "node " + to_string(nodeNumbers[idx]);
+    for (const auto& l : inductors) {
+        if (l.branch == idx) return "the branch of inductor '" + string(names.name(l.component)) + "'";
+    }
+    for (const auto& vs : voltageSources) {
+        if (vs.branch == idx) return "the branch of voltage source '" + string(names.name(vs.component)) + "'";
+    }
+    return "";
+}
+
+struct ThreadPoolOptions {
+    int threadCount = 0;      // 0 uses every hardware thread
+    bool pinThreads = false;  // pin worker i to the (firstCpu + i)-th CPU the process may use, wrapping around
+    int firstCpu = 0;
+    bool reportMetrics = false;  // print the pool metrics to stderr after every outermost parallelFor
+
+    // CIRCUIT_THREADS, CIRCUIT_PIN_THREADS, CIRCUIT_FIRST_CPU and
+    // CIRCUIT_POOL_METRICS.
+    static ThreadPoolOptions fromEnvironment();
+};
+
+ThreadPoolOptions ThreadPoolOptions::fromEnvironment() {
+    ThreadPoolOptions options;
+    if (const char* value = getenv("CIRCUIT_THREADS")) options.threadCount = atoi(value);
+    if (const char* value = getenv("CIRCUIT_PIN_THREADS")) options.pinThreads = *value && string(value) != "0";
+    if (const char* value = getenv("CIRCUIT_FIRST_CPU")) options.firstCpu = max(0, atoi(value));
+    if (const char* value = getenv("CIRCUIT_POOL_METRICS")) options.reportMetrics = *value && string(value) != "0";
+    return options;
+}
+
+struct ThreadPoolMetrics {
+    int threads = 0;
+    long long tasksExecuted = 0;
+    long long steals = 0;       // tasks taken from another worker's deque
+    double idleSeconds = 0.0;   // summed over workers and blocked parallelFor callers
+};
+
+// Work-stealing pool. Every worker owns a deque: tasks submitted from inside
+// a task go to the back of the submitting worker's deque and are popped from
+// there LIFO, idle workers steal from the front of other deques, and tasks
+// submitted from outside the pool enter through a shared injection queue.
+// parallelFor splits an index range into chunks and blocks until all of them
+// ran; the waiting thread executes pool tasks while there are any, so nested
+// parallel loops reuse the same workers rather than adding threads, and sleeps
+// once there is nothing left to help with.
+class ThreadPool {
+private:
+    struct Worker {
+        thread handle;
+        mutex queueMutex;
+        deque<function<void()>> tasks;
+    };
+
+    ThreadPoolOptions options;
+    vector<unique_ptr<Worker>> workers;
+    mutex injectedMutex;
+    deque<function<void()>> injected;
+    atomic<int> pendingTasks{0};
+    mutex sleepMutex;
+    condition_variable taskAvailable;
+    // Wakes parallelFor callers when a loop finishes or new tasks arrive.
+    condition_variable callerWake;
+    atomic<int> blockedCallers{0};
+    bool stopping = false;
+    atomic<long long> tasksExecuted{0};
+    atomic<long long> steals{0};
+    atomic<long long> idleNanoseconds{0};
+    function<void(const ThreadPoolMetrics&)> metricsHook;
+
+    inline static atomic<int> tasksInFlight{0};
+    inline static thread_local ThreadPool* currentPool = nullptr;
+    inline static thread_local int currentWorker = -1;
+    inline static thread_local int taskDepth = 0;
+
+    void workerLoop(int index);
+    void pinWorker(int index);
+    // Queues a task that must not throw.
+    void enqueue(function<void()> task);
+    bool takeTask(function<void()>& task);
+    bool runPendingTask();
+    void run(function<void()>& task);
+
+public:
+    explicit ThreadPool(const ThreadPoolOptions& poolOptions = ThreadPoolOptions());
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    int size() const { return (int)workers.size(); }
+    // The returned future becomes ready when the task has run and rethrows
+    // from get() whatever the task threw. Do not wait on it from inside a
+    // pool task, which can leave every worker blocked; use parallelFor there.
+    future<void> submit(function<void()> task);
+    // Runs body over [0, count) in chunks and returns once all have finished.
+    // If body throws, the chunks not yet started are skipped and the first
+    // exception is rethrown here.
+    void parallelFor(int count, int grainSize, const function<void(int, int)>& body);
+
+    ThreadPoolMetrics metrics() const;
+    // Called after every outermost parallelFor. Set it while the pool is idle.
+    void setMetricsHook(function<void(const ThreadPoolMetrics&)> hook) { metricsHook = move(hook); }
+
+    static ThreadPool& shared();
+    // Tasks currently executing across all pools.
+    static int runningTasks() { return tasksInFlight.load(memory_order_relaxed); }
+};
+
+ThreadPool::ThreadPool(const ThreadPoolOptions& poolOptions) : options(poolOptions) {
+    int threadCount = options.threadCount > 0 ? options.threadCount : (int)max(1u, thread::hardware_concurrency());
+    for (int i = 0; i < threadCount; ++i) workers.push_back(make_unique<Worker>());
+    for (int i = 0; i < threadCount; ++i) {
+        workers[i]->handle = thread([this, i]() { workerLoop(i); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard<mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    taskAvailable.notify_all();
+    for (auto& worker : workers) worker->handle.join();
+}
+
+ThreadPool& ThreadPool::shared() {
+    static ThreadPool pool(ThreadPoolOptions::fromEnvironment());
+    static const bool hookInstalled = []() {
+        if (!pool.options.reportMetrics) return false;
+        pool.setMetricsHook([](const ThreadPoolMetrics& m) {
+            cerr << "Pool: " + to_string(m.threads) + " threads, " + to_string(m.tasksExecuted) + " tasks, " +
+                    to_string(m.steals) + " steals, " + to_string(m.idleSeconds) + " s idle\n";
+        });
+        return true;
+    }();
+    (void)hookInstalled;
+    return pool;
+}
+
+// Picks from the CPUs the process may run on, so a restricted affinity mask
+// or cpuset is respected. A worker that cannot be pinned keeps running
+// unpinned.
+void ThreadPool::pinWorker(int index) {
+#ifdef __linux__
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        cerr << "Warning: Could not read the CPU affinity mask; pool worker " + to_string(index) + " is not pinned.\n";
+        return;
+    }
+    vector<int> cpus;
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &allowed)) cpus.push_back(cpu);
+    }
+    if (cpus.empty()) return;
+    int cpu = cpus[(options.firstCpu + index) % cpus.size()];
+    cpu_set_t target;
+    CPU_ZERO(&target);
+    CPU_SET(cpu, &target);
+    int error = pthread_setaffinity_np(pthread_self(), sizeof(target), &target);
+    if (error != 0) {
+        cerr << "Warning: Could not pin pool worker " + to_string(index) + " to CPU " + to_string(cpu) + ": " +
+                    strerror(error) + ".\n";
+    }
+#else
+    (void)index;
+#endif
+}
+
+future<void> ThreadPool::submit(function<void()> task) {
+    auto job = make_shared<packaged_task<void()>>(move(task));
+    future<void> result = job->get_future();
+    enqueue([job]() { (*job)(); });
+    return result;
+}
+
+void ThreadPool::enqueue(function<void()> task) {
+    if (currentPool == this) {
+        Worker& worker = *workers[currentWorker];
+        lock_guard<mutex> lock(worker.queueMutex);
+        worker.tasks.push_back(move(task));
+    } else {
+        lock_guard<mutex> lock(injectedMutex);
+        injected.push_back(move(task));
+    }
+    pendingTasks.fetch_add(1, memory_order_release);
+    // Taking the sleep lock orders this wakeup after any worker's predicate check.
+    { lock_guard<mutex> lock(sleepMutex); }
+    taskAvailable.notify_one();
+    if (blockedCallers.load(memory_order_relaxed) > 0) callerWake.notify_all();
+}
+
+// Own deque first (newest task), then the injection queue, then the oldest
+// task of the other workers, starting after our own slot.
+bool ThreadPool::takeTask(function<void()>& task) {
+    if (pendingTasks.load(memory_order_acquire) <= 0) return false;
+    int self = currentPool == this ? currentWorker : -1;
+    if (self >= 0) {
+        Worker& worker = *workers[self];
+        lock_guard<mutex> lock(worker.queueMutex);
+        if (!worker.tasks.empty()) {
+            task = move(worker.tasks.back());
+            worker.tasks.pop_back();
+            pendingTasks.fetch_sub(1, memory_order_relaxed);
+            return true;
+        }
+    }
+    {
+        lock_guard<mutex> lock(injectedMutex);
+        if (!injected.empty()) {
+            task = move(injected.front());
+            injected.pop_front();
+            pendingTasks.fetch_sub(1, memory_order_relaxed);
+            return true;
+        }
+    }
+    int count = size();
+    for (int k = 1; k <= count; ++k) {
+        int victim = (self + k + count) % count;
+        if (victim == self) continue;
+        Worker& worker = *workers[victim];
+        lock_guard<mutex> lock(worker.queueMutex);
+        if (!worker.tasks.empty()) {
+            task = move(worker.tasks.front());
+            worker.tasks.pop_front();
+            pendingTasks.fetch_sub(1, memory_order_relaxed);
+            steals.fetch_add(1, memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::workerLoop(int index) {
+    currentPool = this;
+    currentWorker = index;
+    if (options.pinThreads) pinWorker(index);
+    function<void()> task;
+    while (true) {
+        if (takeTask(task)) {
+            run(task);
+            continue;
+        }
+        unique_lock<mutex> lock(sleepMutex);
+        if (pendingTasks.load(memory_order_acquire) > 0) continue;
+        if (stopping) return;
+        auto idleStart = chrono::steady_clock::now();
+        taskAvailable.wait(lock, [this]() { return stopping || pendingTasks.load(memory_order_acquire) > 0; });
+        idleNanoseconds.fetch_add(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - idleStart).count(),
+                                  memory_order_relaxed);
+    }
+}
+
+void ThreadPool::run(function<void()>& task) {
+    struct Running {
+        Running() {
+            tasksInFlight.fetch_add(1, memory_order_relaxed);
+            ++taskDepth;
+        }
+        ~Running() {
+            --taskDepth;
+            tasksInFlight.fetch_sub(1, memory_order_relaxed);
+        }
+    } running;
+    // Counted up front, so metrics taken once a loop or future is done
+    // include all of its tasks.
+    tasksExecuted.fetch_add(1, memory_order_relaxed);
+    task();
+    task = nullptr;
+}
+
+bool ThreadPool::runPendingTask() {
+    function<void()> task;
+    if (!takeTask(task)) return false;
+    run(task);
+    return true;
+}
+
+void ThreadPool::parallelFor(int count, int grainSize, const function<void(int, int)>& body) {
+    if (count <= 0) return;
+    grainSize = max(1, grainSize);
+    int chunkCount = (count + grainSize - 1) / grainSize;
+    atomic<int> remaining(chunkCount);
+    atomic<bool> failed(false);
+    exception_ptr failure;
+    mutex failureMutex;
+    auto fail = [&]() {
+        lock_guard<mutex> lock(failureMutex);
+        if (!failure) failure = current_exception();
+        failed.store(true, memory_order_relaxed);
+    };
+    // Every chunk counts down, thrown or skipped, since the chunks reference
+    // this frame and the wait below must not end before all of them did.
+    for (int chunk = 0; chunk < chunkCount; ++chunk) {
+        int begin = chunk * grainSize;
+        int end = min(count, begin + grainSize);
+        try {
+            enqueue([this, &body, &remaining, &failed, &fail, begin, end]() {
+                if (!failed.load(memory_order_relaxed)) {
+                    try {
+                        body(begin, end);
+                    } catch (...) {
+                        fail();
+                    }
+                }
+                // The frame may be gone once the count reaches zero; only the
+                // pool is touched after it.
+                if (remaining.fetch_sub(1, memory_order_acq_rel) == 1) {
+                    lock_guard<mutex> lock(sleepMutex);
+                    callerWake.notify_all();
+                }
+            });
+        } catch (...) {
+            fail();
+            remaining.fetch_sub(chunkCount - chunk, memory_order_release);
+            break;
+        }
+    }
+    while (remaining.load(memory_order_acquire) > 0) {
+        if (runPendingTask()) continue;
+        unique_lock<mutex> lock(sleepMutex);
+        auto wake = [this, &remaining]() {
+            return remaining.load(memory_order_acquire) == 0 || pendingTasks.load(memory_order_acquire) > 0;
+        };
+        if (wake()) continue;
+        blockedCallers.fetch_add(1, memory_order_relaxed);
+        auto idleStart = chrono::steady_clock::now();
+        callerWake.wait(lock, wake);
+        idleNanoseconds.fetch_add(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - idleStart).count(),
+                                  memory_order_relaxed);
+        blockedCallers.fetch_sub(1, memory_order_relaxed);
+    }
+    if (taskDepth == 0 && metricsHook) metricsHook(metrics());
+    if (failure) rethrow_exception(failure);
+}
+
+ThreadPoolMetrics ThreadPool::metrics() const {
+    ThreadPoolMetrics result;
+    result.threads = size();
+    result.tasksExecuted = tasksExecuted.load(memory_order_relaxed);
+    result.steals = steals.load(memory_order_relaxed);
+    result.idleSeconds = idleNanoseconds.load(memory_order_relaxed) * 1e-9;
+    return result;
+}
+
+// Sorts `items` by `less` on the pool: contiguous chunks are sorted in
+// parallel, then neighbouring runs are merged pairwise until one is left.
+// The result equals std::sort's whenever `less` is a strict total order.
+template <typename T, typename Compare>
+void parallelSort(vector<T>& items, const Compare& less, ThreadPool& pool) {
+    int count = items.size();
+    int chunkCount = max(1, min(pool.size() * 4, count / 4096));
+    if (chunkCount == 1) {
+        sort(items.begin(), items.end(), less);
+        return;
+    }
+    vector<int> bounds(chunkCount + 1);
+    for (int c = 0; c <= chunkCount; ++c) bounds[c] = (int)((long long)count * c / chunkCount);
+    pool.parallelFor(chunkCount, 1, [&](int begin, int end) {
+        for (int c = begin; c < end; ++c) sort(items.begin() + bounds[c], items.begin() + bounds[c + 1], less);
+    });
+    vector<T> merged(count);
+    while (bounds.size() > 2) {
+        int runs = bounds.size() - 1;
+        pool.parallelFor((runs + 1) / 2, 1, [&](int begin, int end) {
+            for (int pair = begin; pair < end; ++pair) {
+                int first = bounds[2 * pair], middle = bounds[min(2 * pair + 1, runs)], last = bounds[min(2 * pair + 2, runs)];
+                merge(items.begin() + first, items.begin() + middle, items.begin() + middle, items.begin() + last,
+                      merged.begin() + first, less);
+            }
+        });
+        items.swap(merged);
+        vector<int> next;
+        for (int c = 0; c < runs; c += 2) next.push_back(bounds[c]);
+        next.push_back(count);
+        bounds.swap(next);
+    }
+}
+
+// Matrix, factorization and RHS storage for one stamp program. prepare()
+// allocates everything and, on the sparse path, runs the symbolic analysis and
+// records where each stamp lands in the compressed value array. factor() and
+// solve() then only reuse that storage. Systems below SPARSE_MNA_THRESHOLD use
+// a dense LU, whose refactor and solve never allocate; SparseLU's triangular
+// solve still allocates one scratch vector per call.
+//
+// Single-element value edits are folded in as rank-1 corrections
+// (e_a - e_b) * delta * (e_a - e_b)^T on top of the existing factorization and
+// applied in solve() with the Woodbury identity. After
+// MAX_LOW_RANK_UPDATES distinct elements the next solve refactors instead.
+//
+// Sparse programs with at least PARALLEL_ASSEMBLY_THRESHOLD stamps build the
+// pattern on the shared pool: every chunk of stamps emits (col, row, stamp)
+// triplets into its own slice, the slices are sorted and merged, and the
+// unique (col, row) pairs become the compressed pattern. factor() then sums
+// each nonzero's stamps in parallel, in stamp order, so every value is
+// rounded exactly as in the serial loop.
+//
+// Copies share the sparse pattern and factorization, which SparseLU cannot
+// copy, and only solve with it; the first copy to refactor takes its own,
+// redoing just the symbolic analysis.
+class MNAWorkspace {
+private:
+    struct RankOneUpdate {
+        int slot;
+        int a;
+        int b;
+        double delta;
+    };
+    struct SparseSystem {
+        Eigen::SparseMatrix<double> matrix;
+        SparseSolver lu;
+        vector<int> valueIndex;
+        vector<int> assemblyOrder;
+        vector<int> assemblyStart;
+    };
+    static const int MAX_LOW_RANK_UPDATES = 16;
+
+    int size = 0;
+    bool dense = true;
+    Eigen::MatrixXd denseMatrix;
+    Eigen::PartialPivLU<Eigen::MatrixXd> denseLU;
+    shared_ptr<SparseSystem> sparse;
+    int singularIdx = -1;
+    double factoredTimeStep = numeric_limits<double>::quiet_NaN();
+    vector<RankOneUpdate> updates;
+    Eigen::MatrixXd updateColumns;
+    Eigen::PartialPivLU<Eigen::MatrixXd> updateLU;
+    // Woodbury scratch, sized with the updates so solve() does not allocate.
+    Eigen::VectorXd projected;
+    Eigen::VectorXd correction;
+
+    void prepareParallelPattern(const StampProgram& program, ThreadPool& pool);
+    void assembleParallel(const StampProgram& program, const vector<double>& coefficients, ThreadPool& pool);
+    void unshareSparseSystem();
+
+public:
+    Eigen::VectorXd rhs;
+
+    void prepare(const StampProgram& program);
+    bool factor(const StampProgram& program, const vector<double>& coefficients, double timeStep);
+    bool addRankOneUpdate(double timeStep, int slot, int a, int b, double delta);
+    void invalidateFactorization();
+    void solve(Eigen::VectorXd& x);
+    bool isFactoredFor(double timeStep) const { return factoredTimeStep == timeStep; }
+    int singularUnknown() const { return singularIdx; }
+    bool isDense() const { return dense; }
+    // Dense factor and solve, pending low-rank updates included, reuse
+    // preallocated storage; SparseLU allocates on every factorization.
+    bool stepsWithoutAllocation() const { return dense && (updates.empty() || projected.size() == (Eigen::Index)updates.size()); }
+};
+
+void MNAWorkspace::prepare(const StampProgram& program) {
+    size = program.size();
+    dense = size < SPARSE_MNA_THRESHOLD;
+    rhs = Eigen::VectorXd::Zero(size + 1);
+    singularIdx = -1;
+    invalidateFactorization();
+    if (dense) {
+        denseMatrix = Eigen::MatrixXd::Zero(size, size);
+        denseLU = Eigen::PartialPivLU<Eigen::MatrixXd>(size);
+        return;
+    }
+
+    sparse = make_shared<SparseSystem>();
+    ThreadPool& pool = ThreadPool::shared();
+    if ((int)program.matrixStamps.size() >= PARALLEL_ASSEMBLY_THRESHOLD && pool.size() > 1) {
+        prepareParallelPattern(program, pool);
+        sparse->lu.analyzePattern(sparse->matrix);
+        return;
+    }
+
+    vector<Eigen::Triplet<double>> pattern;
+    pattern.reserve(program.matrixStamps.size());
+    for (const auto& s : program.matrixStamps) {
+        pattern.emplace_back(s.row, s.col, 0.0);
+    }
+    Eigen::SparseMatrix<double>& matrix = sparse->matrix;
+    matrix.resize(size, size);
+    matrix.setFromTriplets(pattern.begin(), pattern.end());
+    matrix.makeCompressed();
+    const int* outer = matrix.outerIndexPtr();
+    const int* inner = matrix.innerIndexPtr();
+    sparse->valueIndex.resize(program.matrixStamps.size());
+    for (size_t k = 0; k < program.matrixStamps.size(); ++k) {
+        const auto& s = program.matrixStamps[k];
+        sparse->valueIndex[k] = lower_bound(inner + outer[s.col], inner + outer[s.col + 1], s.row) - inner;
+    }
+    sparse->lu.analyzePattern(matrix);
+}
+
+void MNAWorkspace::prepareParallelPattern(const StampProgram& program, ThreadPool& pool) {
+    struct Entry {
+        int col;
+        int row;
+        int stamp;
+    };
+    const vector<MatrixStamp>& stamps = program.matrixStamps;
+    int stampCount = stamps.size();
+    int chunkCount = pool.size() * 4;
+    vector<int> bounds(chunkCount + 1);
+    for (int c = 0; c <= chunkCount; ++c) bounds[c] = (int)((long long)stampCount * c / chunkCount);
+
+    vector<Entry> entries(stampCount);
+    pool.parallelFor(chunkCount, 1, [&](int begin, int end) {
+        for (int k = bounds[begin]; k < bounds[end]; ++k) entries[k] = {stamps[k].col, stamps[k].row, k};
+    });
+    parallelSort(entries, [](const Entry& lhs, const Entry& rhs) {
+        if (lhs.col != rhs.col) return lhs.col < rhs.col;
+        if (lhs.row != rhs.row) return lhs.row < rhs.row;
+        return lhs.stamp < rhs.stamp;
+    }, pool);
+
+    // Entry i starts a new nonzero when its (col, row) differs from entry i - 1.
+    auto startsNonZero = [&entries](int i) {
+        return i == 0 || entries[i].col != entries[i - 1].col || entries[i].row != entries[i - 1].row;
+    };
+    vector<int> firstNonZero(chunkCount + 1, 0);
+    pool.parallelFor(chunkCount, 1, [&](int begin, int end) {
+        for (int c = begin; c < end; ++c) {
+            for (int i = bounds[c]; i < bounds[c + 1]; ++i) firstNonZero[c + 1] += startsNonZero(i);
+        }
+    });
+    for (int c = 0; c < chunkCount; ++c) firstNonZero[c + 1] += firstNonZero[c];
+    int nonZeros = firstNonZero[chunkCount];
+
+    sparse->matrix.resize(size, size);
+    sparse->matrix.resizeNonZeros(nonZeros);
+    int* outer = sparse->matrix.outerIndexPtr();
+    int* inner = sparse->matrix.innerIndexPtr();
+    vector<int>& valueIndex = sparse->valueIndex;
+    vector<int>& assemblyOrder = sparse->assemblyOrder;
+    vector<int>& assemblyStart = sparse->assemblyStart;
+    valueIndex.resize(stampCount);
+    assemblyOrder.resize(stampCount);
+    assemblyStart.resize(nonZeros + 1);
+    pool.parallelFor(chunkCount, 1, [&](int begin, int end) {
+        for (int c = begin; c < end; ++c) {
+            int j = firstNonZero[c] - 1;
+            for (int i = bounds[c]; i < bounds[c + 1]; ++i) {
+                const Entry& e = entries[i];
+                if (startsNonZero(i)) {
+                    ++j;
+                    inner[j] = e.row;
+                    assemblyStart[j] = i;
+                    for (int col = (i == 0 ? -1 : entries[i - 1].col) + 1; col <= e.col; ++col) outer[col] = j;
+                }
+                valueIndex[e.stamp] = j;
+                assemblyOrder[i] = e.stamp;
+            }
+        }
+    });
+    for (int col = (stampCount == 0 ? -1 : entries.back().col) + 1; col <= size; ++col) outer[col] = nonZeros;
+    assemblyStart[nonZeros] = stampCount;
+}
+
+void MNAWorkspace::assembleParallel(const StampProgram& program, const vector<double>& coefficients, ThreadPool& pool) {
+    const vector<MatrixStamp>& stamps = program.matrixStamps;
+    const vector<int>& assemblyOrder = sparse->assemblyOrder;
+    const vector<int>& assemblyStart = sparse->assemblyStart;
+    double* values = sparse->matrix.valuePtr();
+    int nonZeros = sparse->matrix.nonZeros();
+    pool.parallelFor(nonZeros, max(4096, nonZeros / (pool.size() * 4)), [&](int begin, int end) {
+        for (int j = begin; j < end; ++j) {
+            double value = 0.0;
+            for (int p = assemblyStart[j]; p < assemblyStart[j + 1]; ++p) {
+                const MatrixStamp& s = stamps[assemblyOrder[p]];
+                value += s.sign * coefficients[s.slot];
+            }
+            values[j] = value;
+        }
+    });
+}
+
+void MNAWorkspace::unshareSparseSystem() {
+    auto own = make_shared<SparseSystem>();
+    own->matrix = sparse->matrix;
+    own->valueIndex = sparse->valueIndex;
+    own->assemblyOrder = sparse->assemblyOrder;
+    own->assemblyStart = sparse->assemblyStart;
+    own->lu.analyzePattern(own->matrix);
+    sparse = move(own);
+}
+
+void MNAWorkspace::invalidateFactorization() {
+    factoredTimeStep = numeric_limits<double>::quiet_NaN();
+    updates.clear();
+}
+
+bool MNAWorkspace::factor(const StampProgram& program, const vector<double>& coefficients, double timeStep) {
+    updates.clear();
+    const vector<MatrixStamp>& stamps = program.matrixStamps;
+    if (dense) {
+        denseMatrix.setZero();
+        for (const auto& s : stamps) {
+            denseMatrix(s.row, s.col) += s.sign * coefficients[s.slot];
+        }
+        denseLU.compute(denseMatrix);
+        singularIdx = findSingularPivot(denseMatrix, denseLU);
+        factoredTimeStep = singularIdx == -1 ? timeStep : numeric_limits<double>::quiet_NaN();
+        return singularIdx == -1;
+    }
+
+    if (sparse.use_count() > 1) unshareSparseSystem();
+    if (!sparse->assemblyStart.empty()) {
+        assembleParallel(program, coefficients, ThreadPool::shared());
+    } else {
+        double* values = sparse->matrix.valuePtr();
+        fill(values, values + sparse->matrix.nonZeros(), 0.0);
+        for (size_t k = 0; k < stamps.size(); ++k) {
+            values[sparse->valueIndex[k]] += stamps[k].sign * coefficients[stamps[k].slot];
+        }
+    }
+    sparse->lu.factorize(sparse->matrix);
+    singularIdx = findSingularPivot(sparse->matrix, sparse->lu);
+    bool ok = sparse->lu.info() == Eigen::Success && singularIdx == -1;
+    factoredTimeStep = ok ? timeStep : numeric_limits<double>::quiet_NaN();
+    return ok;
+}
+
+// Returns false when the update could not be applied; the factorization is
+// then dropped and the next factor() rebuilds it from the program.
+bool MNAWorkspace::addRankOneUpdate(double timeStep, int slot, int a, int b, double delta) {
+    if (!isFactoredFor(timeStep)) {
+        invalidateFactorization();
+        return false;
+    }
+    int k = 0;
+    while (k < (int)updates.size() && updates[k].slot != slot) ++k;
+    if (k < (int)updates.size()) {
+        updates[k].delta += delta;
+    } else if (k == MAX_LOW_RANK_UPDATES) {
+        invalidateFactorization();
+        return false;
+    } else {
+        Eigen::VectorXd u = Eigen::VectorXd::Zero(size);
+        if (a < size) u(a) += 1.0;
+        if (b < size) u(b) -= 1.0;
+        updates.push_back({slot, a, b, delta});
+        updateColumns.conservativeResize(size + 1, k + 1);
+        updateColumns.col(k).head(size) = dense ? Eigen::VectorXd(denseLU.solve(u)) : Eigen::VectorXd(sparse->lu.solve(u));
+        updateColumns(size, k) = 0.0;
+    }
+
+    // Capacitance matrix I + D * U^T * A0^-1 * U.
+    int count = updates.size();
+    Eigen::MatrixXd capacitance = Eigen::MatrixXd::Identity(count, count);
+    for (int i = 0; i < count; ++i) {
+        const RankOneUpdate& update = updates[i];
+        capacitance.row(i) += update.delta * (updateColumns.row(update.a) - updateColumns.row(update.b));
+    }
+    updateLU.compute(capacitance);
+    if (findSingularPivot(capacitance, updateLU) != -1) {
+        invalidateFactorization();
+        return false;
+    }
+    projected.resize(count);
+    correction.resize(count);
+    return true;
+}
+
+void MNAWorkspace::solve(Eigen::VectorXd& x) {
+    if (dense) {
+        x.head(size) = denseLU.solve(rhs.head(size));
+    } else {
+        x.head(size) = sparse->lu.solve(rhs.head(size));
+    }
+    if (updates.empty()) return;
+
+    // Woodbury: x = y - W * (I + D U^T W)^-1 * D U^T y, with y = A0^-1 b and
+    // W = A0^-1 U. Row `size` of W and entry `size` of x stand in for ground.
+    for (size_t i = 0; i < updates.size(); ++i) {
+        projected(i) = updates[i].delta * (x(updates[i].a) - x(updates[i].b));
+    }
+    correction.noalias() = updateLU.solve(projected);
+    x.head(size).noalias() -= updateColumns.topRows(size) * correction;
+}
+
+// Read-only description of a circuit at one point in time. Circuits hand out
+// snapshots through shared_ptr<const NetlistSnapshot>; edits build a new one
+// instead of changing a snapshot that analyses may still be reading. The
+// netlist is shared with the circuit, and only its structure (names, types,
+// positions and nodes) is read through the snapshot: element values, sources
+// and initial conditions are taken from the program compiled with it, so value
+// edits that the circuit applies to its netlist in place do not show through.
+struct NetlistSnapshot {
+    shared_ptr<const CompactNetlist> netlist;
+    StampProgram program;
+
+    // Voltage source stamps come first in the program, then current sources.
+    int sourceStampIndex(int id) const {
+        int pos = netlist->positions[id];
+        if (netlist->types[id] == ComponentType::VOLTAGE_SOURCE) return pos;
+        return netlist->voltageSources.size() + pos;
+    }
+};
+
+// Companion models used for C and L in transient steps. Backward Euler is
+// first order and damps; the trapezoidal rule is second order and keeps LC
+// energy, at the cost of ringing after discontinuities. Gear switches between
+// BDF1 (backward Euler) and BDF2 on truncation error estimates; both orders
+// damp stiff modes, so stiff networks take large steps without ringing.
+enum class IntegrationMethod {
+    BACKWARD_EULER,
+    TRAPEZOIDAL,
+    GEAR
+};
+
+string integrationMethodName(IntegrationMethod method) {
+    switch (method) {
+        case IntegrationMethod::BACKWARD_EULER: return "Backward Euler";
+        case IntegrationMethod::TRAPEZOIDAL: return "Trapezoidal";
+        case IntegrationMethod::GEAR: return "Gear (BDF order 1-2)";
+        default: return "Unknown";
+    }
+}
+
+// Transient settings kept per circuit and applied to every run on it. With
+// `adaptive` set, transient analysis picks its own steps so the estimated
+// local truncation error stays within the tolerances, and reports on the
+// requested time grid by interpolation.
+struct TransientOptions {
+    IntegrationMethod method = IntegrationMethod::BACKWARD_EULER;
+    bool adaptive = false;
+    double relativeTolerance = 1e-3;
+    double absoluteTolerance = 1e-6;
+    double stepGrowthLimit = 2.0;   // largest factor between consecutive steps
+    double stepShrinkLimit = 0.1;   // smallest factor a rejected step is cut to
+    double maxStep = 0.0;           // 0: a fiftieth of the simulated interval
+    // Start from the DC operating point, with element initial conditions
+    // applied, instead of from all zeros.
+    bool startFromOperatingPoint = false;
+};
+
+// State of one analysis run over a shared snapshot: element and source values
+// overridden for this run, the companion coefficients bound for a step size,
+// the MNA workspace and the solution vectors. A context never writes to its
+// snapshot, so any number of contexts can run on one snapshot concurrently
+// without locks or copies of the netlist.
+class SimulationContext {
+private:
+    shared_ptr<const NetlistSnapshot> snapshot;
+    vector<double> elementValues;
+    vector<double> coefficients;
+    vector<SourceStamp> sources;
+    vector<pair<int, double>> initialConditions;
+    IntegrationMethod method = IntegrationMethod::BACKWARD_EULER;
+    bool dynamic = false;
+    // Companion step the coefficients are bound to, NaN before the first bind.
+    double boundTimeStep = numeric_limits<double>::quiet_NaN();
+    // Per capacitor: history current of the step being solved and the current
+    // at the last accepted solution.
+    vector<double> capacitorHistory;
+    vector<double> capacitorCurrents;
+    // Kept for Gear and under error control: ring of the last accepted
+    // solutions and the steps that led to them, newest at historyNewest, and
+    // the BDF order Gear uses for the next step.
+    static constexpr int HISTORY_DEPTH = 4;
+    bool keepHistory = false;
+    vector<Eigen::VectorXd> history;
+    double historySteps[HISTORY_DEPTH] = {};
+    int historyCount = 0;
+    int historyNewest = 0;
+    int gearOrder = 1;
+    // User step and method order of the last bind, and the BDF2 weights of
+    // x_{n-1} and x_{n-2} relative to the companion coefficient.
+    double boundUserStep = 0.0;
+    int boundOrder = 1;
+    double historyWeight1 = 1.0;
+    double historyWeight2 = 0.0;
+    double relativeTolerance = 1e-3;
+    double absoluteTolerance = 1e-6;
+
+    const Eigen::VectorXd& pastSolution(int back) const {
+        return history[(historyNewest - back + HISTORY_DEPTH) % HISTORY_DEPTH];
+    }
+    double pastStep(int back) const { return historySteps[(historyNewest - back + HISTORY_DEPTH) % HISTORY_DEPTH]; }
+    void resetHistory();
+    void selectGearOrder();
+    void differenceNorms(const Eigen::VectorXd& x, int back, double step, double& second, double& third) const;
+    MNAWorkspace workspace;
+    bool workspacePrepared = false;
+    ostream* diagnostics = &cout;
+
+public:
+    Eigen::VectorXd solution;
+    Eigen::VectorXd previousSolution;
+    double solutionTime = 0.0;
+    bool solutionValid = false;
+
+    explicit SimulationContext(shared_ptr<const NetlistSnapshot> netlistSnapshot);
+
+    const NetlistSnapshot& getSnapshot() const { return *snapshot; }
+    const StampProgram& getProgram() const { return snapshot->program; }
+    int size() const { return snapshot->program.size(); }
+    bool stepsWithoutAllocation() const { return workspace.stepsWithoutAllocation(); }
+    void setDiagnostics(ostream& out) { diagnostics = &out; }
+    double coefficient(int slot) const { return coefficients[slot]; }
+    const SourceStamp& source(int id) const { return sources[snapshot->sourceStampIndex(id)]; }
+    IntegrationMethod getIntegrationMethod() const { return method; }
+    void setIntegrationMethod(IntegrationMethod integrationMethod);
+    // Step the companion coefficients are evaluated at: C / companionStep and
+    // L / companionStep.
+    double companionStep(double timeStep) const;
+    // Order of accuracy of the bound step.
+    int integrationOrder() const { return boundOrder; }
+    // Weights of the error norms: an error of relative * |x| + absolute in
+    // every unknown has norm 1. Also keeps the history that
+    // truncationError() needs.
+    void setErrorTolerances(double relative, double absolute);
+    // Estimated local truncation error of `x`, solved with the bound step from
+    // the last accepted solution, in the weighted max norm. -1 while too few
+    // steps have been accepted to tell.
+    double truncationError(const Eigen::VectorXd& x) const;
+
+    // Matrix part: conductances and companion coefficients, fixed for a given
+    // step size. Rebinding the same step is a no-op.
+    void bindTimeStep(double timeStep);
+    // Overrides one R, C or L value for this run; a live factorization takes it
+    // as a rank-1 update.
+    void setElementValue(int id, double value);
+    void setSource(int id, double offset, double amplitude, double frequency);
+    // Earliest source breakpoint strictly after `time` and the shortest safe
+    // source step; infinity when every source is DC.
+    double nextBreakpoint(double time) const;
+    double maxSourceStep() const;
+    // Overrides a capacitor's or inductor's initial condition; NaN removes it.
+    void setInitialCondition(int id, double value);
+    void resetSolution();
+
+    // RHS part: source values at `time` plus companion history from x_prev,
+    // written to the workspace RHS. Only the entries stamps write to are
+    // cleared; the rest of the RHS stays zero.
+    void assembleRhs(double time, const Eigen::VectorXd& x_prev);
+    // Takes `x`, solved from the last assembleRhs, as the new history point.
+    void acceptStep(const Eigen::VectorXd& x);
+    // Binds `timeStep` and makes sure a factorization for it exists, reporting
+    // a singular matrix otherwise. The factorization survives between calls
+    // until the step size changes.
+    bool factor(double timeStep);
+    // Factors for the bound step, or for DC when none is bound, unless that
+    // factorization already exists; a singular matrix is left for the next
+    // factor() to report. Copies made afterwards start from it.
+    void prefactor();
+    void solve(Eigen::VectorXd& x) { workspace.solve(x); }
+    // One implicit step (or DC solve for timeStep 0) from previousSolution.
+    bool solveStep(double time, double timeStep);
+    // DC operating point at `time` into `solution`, with capacitors open and
+    // inductors shorted except where an initial condition holds them. The
+    // history restarts from it, so the next solveStep continues from there.
+    bool solveOperatingPoint(double time);
+    bool solveDCSourceResponses(const vector<int>& sourceIds, Eigen::VectorXd& base, Eigen::MatrixXd& responses);
+    double componentCurrent(int id) const;
+};
+
+SimulationContext::SimulationContext(shared_ptr<const NetlistSnapshot> netlistSnapshot)
+    : snapshot(move(netlistSnapshot)),
+      elementValues(snapshot->program.elementValues),
+      coefficients(snapshot->program.elementValues),
+      sources(snapshot->program.sourceStamps),
+      initialConditions(snapshot->program.initialConditions),
+      capacitorHistory(snapshot->program.capacitors.size(), 0.0),
+      capacitorCurrents(snapshot->program.capacitors.size(), 0.0) {
+    resetSolution();
+}
+
+void SimulationContext::setIntegrationMethod(IntegrationMethod integrationMethod) {
+    method = integrationMethod;
+    boundTimeStep = numeric_limits<double>::quiet_NaN();
+    resetHistory();
+}
+
+void SimulationContext::setErrorTolerances(double relative, double absolute) {
+    relativeTolerance = relative;
+    absoluteTolerance = absolute;
+    keepHistory = true;
+    resetHistory();
+}
+
+void SimulationContext::resetHistory() {
+    historyCount = 0;
+    historyNewest = 0;
+    gearOrder = 1;
+    if ((method == IntegrationMethod::GEAR || keepHistory) && history.empty()) {
+        history.assign(HISTORY_DEPTH, Eigen::VectorXd::Zero(size() + 1));
+    }
+}
+
+// Variable-step BDF2 with w = h_n / h_{n-1}:
+// x'_n = ((1 + 2w) x_n - (1 + w)^2 x_{n-1} + w^2 x_{n-2}) / ((1 + w) h_n).
+double SimulationContext::companionStep(double timeStep) const {
+    switch (method) {
+        case IntegrationMethod::TRAPEZOIDAL:
+            return timeStep / 2;
+        case IntegrationMethod::GEAR: {
+            if (gearOrder < 2 || historyCount < 2) return timeStep;
+            double ratio = timeStep / pastStep(0);
+            return timeStep * (1 + ratio) / (1 + 2 * ratio);
+        }
+        default:
+            return timeStep;
+    }
+}
+
+void SimulationContext::bindTimeStep(double timeStep) {
+    double step = timeStep > 0 ? companionStep(timeStep) : 0.0;
+    boundUserStep = timeStep;
+    boundOrder = method == IntegrationMethod::TRAPEZOIDAL || step != timeStep ? 2 : 1;
+    historyWeight1 = 1.0;
+    historyWeight2 = 0.0;
+    if (step > 0 && step != timeStep && method == IntegrationMethod::GEAR) {
+        double ratio = timeStep / pastStep(0);
+        historyWeight1 = (1 + ratio) * (1 + ratio) / (1 + 2 * ratio);
+        historyWeight2 = ratio * ratio / (1 + 2 * ratio);
+    }
+    if (step == boundTimeStep) return;
+    boundTimeStep = step;
+    dynamic = step > 0;
+    const StampProgram& program = getProgram();
+    for (size_t slot = 1; slot < elementValues.size(); ++slot) {
+        coefficients[slot] = program.coefficientFor(slot, elementValues[slot], step);
+    }
+}
+
+void SimulationContext::setElementValue(int id, double value) {
+    const StampProgram& program = getProgram();
+    int pos = snapshot->netlist->positions[id];
+    int slot = 0, a = 0, b = program.groundIndex();
+    switch (snapshot->netlist->types[id]) {
+        case ComponentType::RESISTOR:
+            slot = program.resistors[pos].slot;
+            a = program.resistors[pos].a;
+            b = program.resistors[pos].b;
+            break;
+        case ComponentType::CAPACITOR:
+            slot = program.capacitors[pos].slot;
+            a = program.capacitors[pos].a;
+            b = program.capacitors[pos].b;
+            break;
+        case ComponentType::INDUCTOR:
+            slot = program.inductors[pos].slot;
+            a = program.inductors[pos].branch;
+            break;
+        default:
+            return;
+    }
+    elementValues[slot] = value;
+    solutionValid = false;
+    if (isnan(boundTimeStep)) {
+        // The next bind recomputes every coefficient, but a factorization
+        // left from before the unbind would still look current.
+        workspace.invalidateFactorization();
+        return;
+    }
+    double previous = coefficients[slot];
+    coefficients[slot] = program.coefficientFor(slot, value, boundTimeStep);
+    double delta = coefficients[slot] - previous;
+    if (workspacePrepared && delta != 0.0) {
+        workspace.addRankOneUpdate(boundTimeStep, slot, a, b, delta);
+    }
+}
+
+void SimulationContext::setSource(int id, double offset, double amplitude, double frequency) {
+    SourceStamp& stamp = sources[snapshot->sourceStampIndex(id)];
+    stamp.offset = offset;
+    stamp.amplitude = amplitude;
+    stamp.frequency = frequency;
+    solutionValid = false;
+}
+
+void SimulationContext::setInitialCondition(int id, double value) {
+    auto entry = find_if(initialConditions.begin(), initialConditions.end(),
+                         [id](const pair<int, double>& ic) { return ic.first == id; });
+    if (isnan(value)) {
+        if (entry != initialConditions.end()) initialConditions.erase(entry);
+    } else if (entry != initialConditions.end()) {
+        entry->second = value;
+    } else {
+        initialConditions.emplace_back(id, value);
+    }
+}
+
+double SimulationContext::nextBreakpoint(double time) const {
+    double next = numeric_limits<double>::infinity();
+    for (const auto& s : sources) next = min(next, s.nextBreakpoint(time));
+    return next;
+}
+
+double SimulationContext::maxSourceStep() const {
+    double step = numeric_limits<double>::infinity();
+    for (const auto& s : sources) step = min(step, s.maxSafeStep());
+    return step;
+}
+
+void SimulationContext::resetSolution() {
+    solution.setZero(size() + 1);
+    previousSolution.setZero(size() + 1);
+    fill(capacitorCurrents.begin(), capacitorCurrents.end(), 0.0);
+    resetHistory();
+    solutionValid = false;
+}
+
+void SimulationContext::assembleRhs(double time, const Eigen::VectorXd& x_prev) {
+    const StampProgram& program = getProgram();
+    Eigen::VectorXd& z = workspace.rhs;
+    for (const auto& s : sources) {
+        z(s.plus) = 0.0;
+        z(s.minus) = 0.0;
+    }
+    for (const auto& c : program.capacitors) {
+        z(c.a) = 0.0;
+        z(c.b) = 0.0;
+    }
+    for (const auto& l : program.inductors) {
+        z(l.branch) = 0.0;
+    }
+    for (const auto& s : sources) {
+        double value = s.offset + s.amplitude * sin(2 * M_PI * s.frequency * time);
+        z(s.plus) += value;
+        z(s.minus) -= value;
+    }
+    if (!dynamic) return;
+    // Trapezoidal companions add the previous capacitor current and inductor
+    // voltage: i = 2C/h (v - v_prev) - i_prev, v = 2L/h (i - i_prev) - v_prev.
+    // BDF2 weighs in the solution before x_prev from the history ring.
+    bool trapezoidal = method == IntegrationMethod::TRAPEZOIDAL;
+    bool secondOrder = historyWeight2 != 0.0;
+    const Eigen::VectorXd& x_prev2 = secondOrder ? pastSolution(1) : x_prev;
+    for (size_t k = 0; k < program.capacitors.size(); ++k) {
+        const auto& c = program.capacitors[k];
+        double v = x_prev(c.a) - x_prev(c.b);
+        if (secondOrder) v = historyWeight1 * v - historyWeight2 * (x_prev2(c.a) - x_prev2(c.b));
+        double ieq = coefficients[c.slot] * v;
+        if (trapezoidal) ieq += capacitorCurrents[k];
+        capacitorHistory[k] = ieq;
+        z(c.a) += ieq;
+        z(c.b) -= ieq;
+    }
+    for (const auto& l : program.inductors) {
+        double i = x_prev(l.branch);
+        if (secondOrder) i = historyWeight1 * i - historyWeight2 * x_prev2(l.branch);
+        double veq = coefficients[l.slot] * i;
+        if (trapezoidal) veq -= x_prev(l.a) - x_prev(l.b);
+        z(l.branch) += veq;
+    }
+}
+
+void SimulationContext::acceptStep(const Eigen::VectorXd& x) {
+    const StampProgram& program = getProgram();
+    for (size_t k = 0; k < program.capacitors.size(); ++k) {
+        const auto& c = program.capacitors[k];
+        capacitorCurrents[k] = dynamic ? coefficients[c.slot] * (x(c.a) - x(c.b)) - capacitorHistory[k] : 0.0;
     }
+    if ((method != IntegrationMethod::GEAR && !keepHistory) || !dynamic) return;
+    historyNewest = (historyNewest + 1) % HISTORY_DEPTH;
+    history[historyNewest] = x;
+    historySteps[historyNewest] = boundUserStep;
+    historyCount = min(historyCount + 1, HISTORY_DEPTH);
+    if (method == IntegrationMethod::GEAR) selectGearOrder();
+}
 
-    int getNode1() const { return node1; }
-    int getNode2() const { return node2; }
-};
+// Weighted max norms of h^2 [x, x_1, x_2] and h^3 [x, x_1, x_2, x_3], where
+// x_1, x_2, ... are the ring entries from `back` on and h is the step that led
+// to x. A norm is -1 while the ring is too short for it.
+void SimulationContext::differenceNorms(const Eigen::VectorXd& x, int back, double step, double& second,
+                                        double& third) const {
+    int available = historyCount - back;
+    second = third = -1.0;
+    if (available < 2) return;
+    bool cubic = available >= 3;
+    const Eigen::VectorXd& x1 = pastSolution(back);
+    const Eigen::VectorXd& x2 = pastSolution(back + 1);
+    const Eigen::VectorXd& x3 = cubic ? pastSolution(back + 2) : x2;
+    double h0 = step, h1 = pastStep(back), h2 = cubic ? pastStep(back + 1) : 1.0;
+    second = 0.0;
+    if (cubic) third = 0.0;
+    for (int i = 0; i < size(); ++i) {
+        double d0 = (x(i) - x1(i)) / h0;
+        double d1 = (x1(i) - x2(i)) / h1;
+        double dd0 = (d0 - d1) / (h0 + h1);
+        double weight = relativeTolerance * abs(x(i)) + absoluteTolerance;
+        second = max(second, abs(h0 * h0 * dd0) / weight);
+        if (!cubic) continue;
+        double d2 = (x2(i) - x3(i)) / h2;
+        double dd1 = (d1 - d2) / (h1 + h2);
+        double ddd = (dd0 - dd1) / (h0 + h1 + h2);
+        third = max(third, abs(h0 * h0 * h0 * ddd) / weight);
+    }
+}
 
-class Resistor : public Component {
-private:
-    double resistance;
-    string unit;
+// Leading error terms: backward Euler h^2 x^(2) / 2, trapezoidal h^3 x^(3) / 12
+// and BDF2 2/9 h^3 x^(3), with x^(k) = k! times the k-th divided difference.
+double SimulationContext::truncationError(const Eigen::VectorXd& x) const {
+    double second = -1.0, third = -1.0;
+    differenceNorms(x, 0, boundUserStep, second, third);
+    if (boundOrder == 1) return second;
+    if (third < 0) return -1.0;
+    return method == IntegrationMethod::TRAPEZOIDAL ? third / 2 : 4.0 / 3.0 * third;
+}
 
-public:
-    Resistor(const string& name, double res, int n1, int n2)
-            : Component(name, n1, n2), resistance(res), unit("Ohm") {}
+// After each accepted Gear step: BDF1's error is h^2 [x_n, x_{n-1}, x_{n-2}]
+// and BDF2's is 4/3 h^3 [x_n, ..., x_{n-3}] (see truncationError). The order
+// goes up when BDF2's estimate is the smaller one and back down only once it
+// is twice BDF1's, so it does not chatter on oscillating solutions.
+void SimulationContext::selectGearOrder() {
+    double firstOrderError = -1.0, secondOrderError = -1.0;
+    differenceNorms(pastSolution(0), 1, pastStep(0), firstOrderError, secondOrderError);
+    if (secondOrderError < 0) {
+        gearOrder = 1;
+        return;
+    }
+    secondOrderError *= 4.0 / 3.0;
+    if (secondOrderError < firstOrderError) gearOrder = 2;
+    else if (secondOrderError > 2 * firstOrderError) gearOrder = 1;
+}
 
-    void display() const override {
-        cout << "  - Element: " << name << " | Type: " << getType()
-             << " | Value: " << scientific << setprecision(4) << resistance << " " << unit
-             << " | Nodes: (" << node1 << ", " << node2 << ")" << endl;
+bool SimulationContext::factor(double timeStep) {
+    bindTimeStep(timeStep);
+    if (!workspacePrepared) {
+        workspace.prepare(getProgram());
+        workspacePrepared = true;
     }
-    string getType() const override { return "Resistor"; }
-    string serialize() const override {
-        stringstream ss;
-        ss << "Resistor " << name << " " << resistance << " " << node1 << " " << node2;
-        return ss.str();
+    if (workspace.isFactoredFor(boundTimeStep)) {
+        return true;
+    }
+    if (workspace.factor(getProgram(), coefficients, boundTimeStep)) {
+        return true;
     }
+    reportSingularMatrix(getProgram().describeUnknown(workspace.singularUnknown(), snapshot->netlist->names), *diagnostics);
+    return false;
+}
 
-    void setResistance(double res) { this->resistance = res; }
-    double getResistance() const { return resistance; }
-};
+void SimulationContext::prefactor() {
+    if (size() == 0) return;
+    bindTimeStep(isnan(boundTimeStep) ? 0.0 : boundUserStep);
+    if (!workspacePrepared) {
+        workspace.prepare(getProgram());
+        workspacePrepared = true;
+    }
+    if (!workspace.isFactoredFor(boundTimeStep)) workspace.factor(getProgram(), coefficients, boundTimeStep);
+}
 
-class Capacitor : public Component {
-private:
-    double capacitance;
-    string unit;
+bool SimulationContext::solveStep(double time, double timeStep) {
+    solutionValid = false;
+    // The last solution becomes the history for this step; the buffers are
+    // only swapped, never copied.
+    solution.swap(previousSolution);
+    solutionTime = time;
+    if (size() == 0) {
+        solutionValid = true;
+        return true;
+    }
+    if (!factor(timeStep)) {
+        return false;
+    }
+    assembleRhs(time, previousSolution);
+    workspace.solve(solution);
+    acceptStep(solution);
+    solutionValid = true;
+    return true;
+}
 
-public:
-    Capacitor(const string& name, double cap, int n1, int n2)
-            : Component(name, n1, n2), capacitance(cap), unit("F") {}
+// Initial conditions go in as stiff Norton equivalents on the DC matrix: a
+// capacitor becomes INITIAL_CONDITION_STIFFNESS in parallel with a current
+// source of stiffness * v0, an inductor's shorted branch gets the stiffness as
+// series resistance and a source of stiffness * i0. The current a held
+// capacitor draws is its starting current for the trapezoidal rule.
+bool SimulationContext::solveOperatingPoint(double time) {
+    const StampProgram& program = getProgram();
+    const CompactNetlist& netlist = *snapshot->netlist;
+    solutionValid = false;
+    solutionTime = time;
+    fill(capacitorHistory.begin(), capacitorHistory.end(), 0.0);
+    fill(capacitorCurrents.begin(), capacitorCurrents.end(), 0.0);
+    resetHistory();
+    if (size() == 0) {
+        solutionValid = true;
+        return true;
+    }
 
-    void display() const override {
-        cout << "  - Element: " << name << " | Type: " << getType() << " | Value: " << scientific << setprecision(4) << capacitance << " " << unit << " | Nodes: (" << node1 << ", " << node2 << ")" << endl;
+    bindTimeStep(0.0);
+    auto slotOf = [&](int id) {
+        int pos = netlist.positions[id];
+        return netlist.types[id] == ComponentType::CAPACITOR ? program.capacitors[pos].slot : program.inductors[pos].slot;
+    };
+    for (const auto& [id, value] : initialConditions) {
+        bool capacitor = netlist.types[id] == ComponentType::CAPACITOR;
+        coefficients[slotOf(id)] = capacitor ? INITIAL_CONDITION_STIFFNESS : -INITIAL_CONDITION_STIFFNESS;
     }
-    string getType() const override { return "Capacitor"; }
-    string serialize() const override {
-        stringstream ss;
-        ss << "Capacitor " << name << " " << capacitance << " " << node1 << " " << node2;
-        return ss.str();
+    bool held = !initialConditions.empty();
+    if (held) workspace.invalidateFactorization();
+    bool ok = factor(0.0);
+    if (ok) {
+        assembleRhs(time, solution);
+        Eigen::VectorXd& z = workspace.rhs;
+        for (const auto& [id, value] : initialConditions) {
+            int pos = netlist.positions[id];
+            double source = coefficients[slotOf(id)] * value;
+            if (netlist.types[id] == ComponentType::CAPACITOR) {
+                const auto& c = program.capacitors[pos];
+                capacitorHistory[pos] = source;
+                z(c.a) += source;
+                z(c.b) -= source;
+            } else {
+                z(program.inductors[pos].branch) += source;
+            }
+        }
+        workspace.solve(solution);
+        for (const auto& [id, value] : initialConditions) {
+            int pos = netlist.positions[id];
+            if (netlist.types[id] != ComponentType::CAPACITOR) continue;
+            const auto& c = program.capacitors[pos];
+            capacitorCurrents[pos] = coefficients[c.slot] * (solution(c.a) - solution(c.b)) - capacitorHistory[pos];
+        }
+        previousSolution = solution;
+        solutionValid = true;
+    }
+    if (held) {
+        for (const auto& ic : initialConditions) {
+            int slot = slotOf(ic.first);
+            coefficients[slot] = program.coefficientFor(slot, elementValues[slot], 0.0);
+        }
+        workspace.invalidateFactorization();
     }
+    return ok;
+}
 
-    void setCapacitance(double cap) { this->capacitance = cap; }
-    double getCapacitance() const { return capacitance; }
-};
+// Superposition for linear DC sweeps: `base` is the operating point with the
+// listed sources switched off and column k of `responses` is the solution for
+// source k alone at one unit (1 V or 1 A). Any combination of values v for
+// those sources then solves to base + responses * v, so a sweep costs one
+// factorization and sourceIds.size() + 1 solves however many points it has.
+bool SimulationContext::solveDCSourceResponses(const vector<int>& sourceIds, Eigen::VectorXd& base,
+                                               Eigen::MatrixXd& responses) {
+    int n = size();
+    base = Eigen::VectorXd::Zero(n + 1);
+    responses = Eigen::MatrixXd::Zero(n + 1, sourceIds.size());
+    if (n == 0) return true;
+    if (!factor(0.0)) return false;
+
+    Eigen::VectorXd& rhs = workspace.rhs;
+    assembleRhs(0.0, base);
+    for (int id : sourceIds) {
+        const SourceStamp& s = source(id);
+        rhs(s.plus) -= s.offset;
+        rhs(s.minus) += s.offset;
+    }
+    workspace.solve(base);
+
+    Eigen::VectorXd unit = Eigen::VectorXd::Zero(n + 1);
+    for (size_t k = 0; k < sourceIds.size(); ++k) {
+        const SourceStamp& s = source(sourceIds[k]);
+        rhs.setZero();
+        rhs(s.plus) += 1.0;
+        rhs(s.minus) -= 1.0;
+        workspace.solve(unit);
+        responses.col(k) = unit;
+    }
+    rhs.setZero();
+    return true;
+}
 
-class Inductor : public Component {
+double SimulationContext::componentCurrent(int id) const {
+    const CompactNetlist& netlist = *snapshot->netlist;
+    if (!solutionValid || id < 0 || id >= netlist.size()) {
+        return 0.0;
+    }
+    const StampProgram& program = getProgram();
+    const Eigen::VectorXd& x = solution;
+    int pos = netlist.positions[id];
+    switch (netlist.types[id]) {
+        case ComponentType::RESISTOR: {
+            const auto& r = program.resistors[pos];
+            return (x(r.a) - x(r.b)) * coefficients[r.slot];
+        }
+        case ComponentType::CAPACITOR:
+            return capacitorCurrents[pos];
+        case ComponentType::INDUCTOR:
+            return x(program.inductors[pos].branch);
+        case ComponentType::VOLTAGE_SOURCE:
+            return x(program.voltageSources[pos].branch);
+        case ComponentType::CURRENT_SOURCE: {
+            const SourceStamp& cs = source(id);
+            return cs.offset + cs.amplitude * sin(2 * M_PI * cs.frequency * solutionTime);
+        }
+        default:
+            return 0.0;
+    }
+}
+
+// Debug builds make Eigen assert on any heap allocation while this guard is
+// alive. Eigen's switch is process-wide, so the guard stays off while any pool
+// task or a second analysis runs and might legitimately allocate. Release
+// builds compile it away.
+class NoHeapAllocationScope {
 private:
-    double inductance;
-    string unit;
+    bool armed = false;
+    bool previous = true;
+    inline static atomic<int> analysesInFlight{0};
 
 public:
-    Inductor(const string& name, double ind, int n1, int n2)
-            : Component(name, n1, n2), inductance(ind), unit("H") {}
-
-    void display() const override {
-        cout << "  - Element: " << name << " | Type: " << getType() << " | Value: " << scientific << setprecision(4) << inductance << " " << unit << " | Nodes: (" << node1 << ", " << node2 << ")" << endl;
+    // Held by every analysis that may run on its own thread, for its whole run.
+    class Analysis {
+    public:
+        Analysis() { analysesInFlight.fetch_add(1, memory_order_relaxed); }
+        ~Analysis() { analysesInFlight.fetch_sub(1, memory_order_relaxed); }
+        Analysis(const Analysis&) = delete;
+        Analysis& operator=(const Analysis&) = delete;
+    };
+
+    explicit NoHeapAllocationScope(bool enabled = true) {
+#ifdef EIGEN_RUNTIME_NO_MALLOC
+        armed = enabled && ThreadPool::runningTasks() == 0 && analysesInFlight.load(memory_order_relaxed) <= 1;
+        if (armed) {
+            previous = Eigen::internal::is_malloc_allowed();
+            Eigen::internal::set_is_malloc_allowed(false);
+        }
+#else
+        (void)enabled;
+#endif
     }
-    string getType() const override { return "Inductor"; }
-    string serialize() const override {
-        stringstream ss;
-        ss << "Inductor " << name << " " << inductance << " " << node1 << " " << node2;
-        return ss.str();
+    ~NoHeapAllocationScope() {
+#ifdef EIGEN_RUNTIME_NO_MALLOC
+        if (armed) Eigen::internal::set_is_malloc_allowed(previous);
+#endif
     }
+    NoHeapAllocationScope(const NoHeapAllocationScope&) = delete;
+    NoHeapAllocationScope& operator=(const NoHeapAllocationScope&) = delete;
+};
 
-    void setInductance(double ind) { this->inductance = ind; }
-    double getInductance() const { return inductance; }
+// One swept source of a multi-source DC sweep. The grid along this axis is
+// start, start + step, ... up to end, as in the single-source sweeps.
+struct SweepAxis {
+    string source;
+    double start;
+    double end;
+    double step;
+
+    int pointCount() const { return (int)floor((end - start) / step + 0.5) + 1; }
+    double valueAt(int i) const { return start + i * step; }
 };
 
-class VoltageSource : public Component {
-public:
-    enum class Waveform { DC, SINE };
+// Dense sweep output. Points run over the grid with the last axis varying
+// fastest; row p of `sourceValues` holds the swept values of point p and row p
+// of `values` the probes measured there.
+struct SweepResult {
+    vector<string> sources;
+    vector<string> probes;
+    Eigen::MatrixXd sourceValues;
+    Eigen::MatrixXd values;
+};
+
+class DisjointSet {
 private:
-    Waveform waveformType;
-    double offset_or_dc_value;
-    double amplitude;
-    double frequency;
-    string unit;
+    vector<int> parent;
+    vector<int> rank;
 
 public:
-    VoltageSource(const string& name, double dc_val, int n1, int n2)
-            : Component(name, n1, n2), waveformType(Waveform::DC), offset_or_dc_value(dc_val),
-              amplitude(0), frequency(0), unit("V") {}
-
-    VoltageSource(const string& name, double offset, double amp, double freq, int n1, int n2)
-            : Component(name, n1, n2), waveformType(Waveform::SINE), offset_or_dc_value(offset),
-              amplitude(amp), frequency(freq), unit("V") {}
-
-    double getValueAtTime(double time) const {
-        if (waveformType == Waveform::SINE) return offset_or_dc_value + amplitude * sin(2 * M_PI * frequency * time);
-        return offset_or_dc_value;
+    explicit DisjointSet(int size) : parent(size), rank(size, 0) {
+        for (int i = 0; i < size; ++i) parent[i] = i;
     }
 
-    void display() const override {
-        cout << "  - Element: " << name << " | Type: " << getType();
-        if (waveformType == Waveform::DC) {
-            cout << " (DC) | Value: " << scientific << setprecision(4) << offset_or_dc_value << " " << unit;
-        } else {
-            cout << " (SINE) | Params: Offset=" << scientific << setprecision(4) << offset_or_dc_value << ", Amp=" << scientific << setprecision(4) << amplitude << ", Freq=" << scientific << setprecision(4) << frequency << "Hz";
+    int find(int x) {
+        while (parent[x] != x) {
+            parent[x] = parent[parent[x]];
+            x = parent[x];
         }
-        cout << " | Nodes: (" << node1 << ", " << node2 << ")" << endl;
+        return x;
     }
 
-    string getType() const override { return "Voltage Source"; }
-    string serialize() const override {
-        stringstream ss;
-        ss << "VoltageSource " << name << " " << (waveformType == Waveform::DC ? "DC" : "SINE") << " "
-           << offset_or_dc_value << " " << amplitude << " " << frequency << " " << node1 << " " << node2;
-        return ss.str();
+    bool unite(int a, int b) {
+        a = find(a);
+        b = find(b);
+        if (a == b) return false;
+        if (rank[a] < rank[b]) swap(a, b);
+        parent[b] = a;
+        if (rank[a] == rank[b]) rank[a]++;
+        return true;
     }
+};
 
-    Waveform getWaveformType() const { return waveformType; }
-    void setDCOffsetValue(double val) { this->offset_or_dc_value = val; }
-    void setAmplitude(double amp) { this->amplitude = amp; }
-    void setFrequency(double freq) { this->frequency = freq; }
+struct TopologyReport {
+    vector<string> errors;
+    vector<string> warnings;
+
+    bool isValid() const { return errors.empty(); }
 };
 
-class CurrentSource : public Component {
+// Receives a transient run as it is computed. Rows hold the reported
+// quantities in label order: node voltages by node number, then inductor and
+// voltage source currents by name.
+class TransientSink {
 public:
-    enum class Waveform { DC, SINE };
+    virtual ~TransientSink() = default;
+    virtual void begin(const vector<string>& labels) = 0;
+    virtual void row(double time, const Eigen::VectorXd& values) = 0;
+    virtual void end() = 0;
+};
+
+// Streams a run in the interactive transient report format.
+class TransientPrinter : public TransientSink {
 private:
-    Waveform waveformType;
-    double offset_or_dc_value;
-    double amplitude;
-    double frequency;
-    string unit;
+    ostream& out;
+    vector<string> labels;
 
 public:
-    CurrentSource(const string& name, double dc_val, int n1, int n2)
-            : Component(name, n1, n2), waveformType(Waveform::DC), offset_or_dc_value(dc_val),
-              amplitude(0), frequency(0), unit("A") {}
-
-    CurrentSource(const string& name, double offset, double amp, double freq, int n1, int n2)
-            : Component(name, n1, n2), waveformType(Waveform::SINE), offset_or_dc_value(offset),
-              amplitude(amp), frequency(freq), unit("A") {}
-
-    double getValueAtTime(double time) const {
-        if (waveformType == Waveform::SINE) return offset_or_dc_value + amplitude * sin(2 * M_PI * frequency * time);
-        return offset_or_dc_value;
+    explicit TransientPrinter(ostream& stream) : out(stream) {}
+    void begin(const vector<string>& runLabels) override {
+        labels = runLabels;
+        out << "--- Starting Transient Analysis ---" << endl;
+        out << scientific << setprecision(6);
     }
-
-    void display() const override {
-        cout << "  - Element: " << name << " | Type: " << getType();
-        if (waveformType == Waveform::DC) {
-            cout << " (DC) | Value: " << scientific << setprecision(4) << offset_or_dc_value << " " << unit;
-        } else {
-            cout << " (SINE) | Params: Offset=" << scientific << setprecision(4) << offset_or_dc_value << ", Amp=" << scientific << setprecision(4) << amplitude << ", Freq=" << scientific << setprecision(4) << frequency << "Hz";
+    void row(double time, const Eigen::VectorXd& values) override {
+        out << "\nTime: " << time << "s" << endl;
+        for (size_t i = 0; i < labels.size(); ++i) {
+            out << "  " << labels[i] << ": " << values(i) << (labels[i][0] == 'V' ? " V" : " A") << endl;
         }
-        cout << " | Nodes: (" << node1 << ", " << node2 << ")" << endl;
     }
+    void end() override { out << "--- Transient Analysis Finished ---" << endl; }
+};
 
-    string getType() const override { return "Current Source"; }
-    string serialize() const override {
-        stringstream ss;
-        ss << "CurrentSource " << name << " " << (waveformType == Waveform::DC ? "DC" : "SINE") << " "
-           << offset_or_dc_value << " " << amplitude << " " << frequency << " " << node1 << " " << node2;
-        return ss.str();
+// Keeps a whole run in memory, row-major, for callers that collect results.
+class TransientResult : public TransientSink {
+public:
+    vector<string> labels;
+    vector<double> times;
+    vector<double> values;
+    bool finished = false;
+
+    void begin(const vector<string>& runLabels) override { labels = runLabels; }
+    void row(double time, const Eigen::VectorXd& rowValues) override {
+        times.push_back(time);
+        values.insert(values.end(), rowValues.data(), rowValues.data() + rowValues.size());
     }
+    void end() override { finished = true; }
+    void replay(TransientSink& sink) const;
+};
 
-    Waveform getWaveformType() const { return waveformType; }
-    void setDCOffsetValue(double val) { this->offset_or_dc_value = val; }
-    void setAmplitude(double amp) { this->amplitude = amp; }
-    void setFrequency(double freq) { this->frequency = freq; }
+void TransientResult::replay(TransientSink& sink) const {
+    sink.begin(labels);
+    Eigen::VectorXd rowValues(labels.size());
+    for (size_t t = 0; t < times.size(); ++t) {
+        for (size_t i = 0; i < labels.size(); ++i) rowValues(i) = values[t * labels.size() + i];
+        sink.row(times[t], rowValues);
+    }
+    if (finished) sink.end();
+}
+
+// A run kept in memory together with the log written while it ran, for runs
+// computed off the console. Each sink call marks how much of the log came
+// before it, so replay can print both in the order they were produced.
+class LoggedTransientResult : public TransientResult {
+private:
+    vector<streamoff> logMarks;
+
+    void mark() { logMarks.push_back(max<streamoff>(log.tellp(), 0)); }
+
+public:
+    stringstream log;
+
+    void begin(const vector<string>& runLabels) override { mark(); TransientResult::begin(runLabels); }
+    void row(double time, const Eigen::VectorXd& rowValues) override { mark(); TransientResult::row(time, rowValues); }
+    void end() override { mark(); TransientResult::end(); }
+    void replay(TransientSink& sink, ostream& out) const;
 };
 
+void LoggedTransientResult::replay(TransientSink& sink, ostream& out) const {
+    // Forwards each call after printing the log written before it.
+    class Interleaver : public TransientSink {
+    private:
+        TransientSink& target;
+        ostream& out;
+        const string text;
+        const vector<streamoff>& marks;
+        size_t next = 0;
+        streamoff printed = 0;
+
+    public:
+        Interleaver(TransientSink& sink, ostream& stream, string logText, const vector<streamoff>& logMarks)
+                : target(sink), out(stream), text(std::move(logText)), marks(logMarks) {}
+        void flush(streamoff upTo) {
+            out << text.substr(printed, upTo - printed);
+            printed = upTo;
+        }
+        void flushToNextMark() { flush(next < marks.size() ? marks[next++] : (streamoff)text.size()); }
+        void flushAll() { flush(text.size()); }
+        void begin(const vector<string>& labels) override { flushToNextMark(); target.begin(labels); }
+        void row(double time, const Eigen::VectorXd& values) override { flushToNextMark(); target.row(time, values); }
+        void end() override { flushToNextMark(); target.end(); }
+    };
+
+    Interleaver interleaver(sink, out, log.str(), logMarks);
+    if (finished) TransientResult::replay(interleaver);
+    interleaver.flushAll();
+}
+
 class Circuit {
 private:
-    vector<unique_ptr<Component>> components;
-    set<int> getAllNodes() const;
-    map<int, double> nodeVoltages;
-    map<string, double> componentCurrents;
-    map<int, double> previousNodeVoltages;
-    map<string, double> previousComponentCurrents;
+    // Owning store of the elements. Value edits change it in place; structural
+    // edits first give it up if a snapshot elsewhere still shares it.
+    shared_ptr<CompactNetlist> elements = make_shared<CompactNetlist>();
+    NodeNumbering nodeNumbering;
     string circuitName;
+    TopologyReport topologyReport;
+    bool topologyValid = false;
+    // Snapshot of the current elements and values, built on first use.
+    mutable shared_ptr<const NetlistSnapshot> snapshot;
+    // Guards building the topology report, the snapshot and the live context.
+    // Edits still must not overlap analyses of the same circuit.
+    mutable mutex cacheMutex;
+    // Interactive state kept between setupAndSolveMNA calls: the last solution
+    // and a live factorization that value edits patch in place.
+    unique_ptr<SimulationContext> context;
+    TransientOptions transientOptions;
+
+    void invalidateTopology() {
+        topologyValid = false;
+        invalidateSnapshot();
+    }
+    void invalidateSnapshot() {
+        snapshot.reset();
+        context.reset();
+    }
+    CompactNetlist& editStructure();
+    void resetSolution();
+    const CompactNetlist& getCompactNetlist() const { return *elements; }
+    const shared_ptr<const NetlistSnapshot>& currentSnapshot() const;
+    SimulationContext& liveContext();
+    SimulationContext& getContext();
+    SimulationContext seedContext();
+    void printSolution(const SimulationContext& run) const;
+    bool stepAdaptively(SimulationContext& run, double startTime, double endTime, double outputStep,
+                        const vector<int>& reported, TransientSink& sink, ostream& log);
 
 public:
     Circuit(string name = "Unnamed Circuit") : circuitName(name) {}
+    shared_ptr<const NetlistSnapshot> getSnapshot() const;
     void addElement(unique_ptr<Component> newComponent);
     bool removeElement(const string& componentName);
-    Component* findElement(const string& componentName);
+    // A copy built from the netlist, or null; edits go through
+    // setElementNodes and setElementParameter.
+    unique_ptr<Component> findElement(const string& componentName) const;
     void displayCircuit() const;
     void runTransientAnalysis(double startTime, double endTime, double timeStep);
+    bool computeTransient(double startTime, double endTime, double timeStep, TransientSink& sink, ostream& log = cout);
     void simulateMultipleVariables(double startTime, double endTime, double timeStep);
-    void simulateDCVoltageSweep(double startVoltage, double endVoltage, double stepVoltage);
-    void simulateDCCurrentSweep(double startCurrent, double endCurrent, double stepCurrent);
+    void simulateDCVoltageSweep(double startVoltage, double endVoltage, double stepVoltage, const string& sourceName = "");
+    void simulateDCCurrentSweep(double startCurrent, double endCurrent, double stepCurrent, const string& sourceName = "");
+    void simulateParameterSweep(const string& componentName, double startValue, double endValue, double stepValue,
+                                double timeStep = 0.0, double endTime = 0.0);
+    bool sweepSources(const vector<SweepAxis>& axes, const vector<string>& probes, SweepResult& result,
+                      ThreadPool& pool = ThreadPool::shared());
+    void simulateMultiSourceSweep(const vector<SweepAxis>& axes, const vector<string>& probes);
     bool hasGround() const;
     void displayNodes() const;
     bool renameNode(int oldNodeNum, int newNodeNum);
-    const vector<unique_ptr<Component>>& getComponents() const { return components; }
+    bool setElementNodes(const string& componentName, int newNode1, int newNode2);
+    bool setElementParameter(const string& componentName, ElementParameter parameter, double value);
+    const TopologyReport& validateTopology();
+    bool checkTopology(ostream& out = cout);
     bool setupAndSolveMNA(double time, double timeStep);
-    double getNodeVoltage(int node) const;
     double getComponentCurrent(const string& name) const;
+    double getComponentCurrent(int id) const;
+    void printSolution() const;
     void saveCircuit(const string& filename) const;
     bool loadCircuit(const string& filename);
     string getCircuitName() const { return circuitName; }
     void setCircuitName(const string& name) { circuitName = name; }
+    const TransientOptions& getTransientOptions() const { return transientOptions; }
+    void setTransientOptions(const TransientOptions& options);
 };
 
-set<int> Circuit::getAllNodes() const {
-    set<int> unique_nodes;
-    for (const auto& comp : components) {
-        unique_nodes.insert(comp->getNode1());
-        unique_nodes.insert(comp->getNode2());
-    }
-    return unique_nodes;
-}
-
 double parseEngineeringValue(const string& valStr) {
     if (valStr.empty()) return 0.0;
     size_t first_char_pos = string::npos;
@@ -308,6 +2611,7 @@ public:
     Circuit* getActiveCircuit() const;
     void selectCircuit();
     void removeActiveCircuit();
+    void runTransientOnAll(double startTime, double endTime, double timeStep, ThreadPool& pool = ThreadPool::shared());
 };
 
 
@@ -321,6 +2625,8 @@ void handleErrorNodeNotFound(int node);
 void pauseSystem();
 void handleTransientAnalysis(Circuit& circuit);
 void handleMultipleVariablesAnalysis(Circuit& circuit);
+void handleParameterSweep(Circuit& circuit);
+void handleMultiSourceSweep(Circuit& circuit);
 void handleDisplayNodes(const Circuit& circuit);
 void handleRenameNode(Circuit& circuit);
 bool safelyReadDouble(double& val, const string& prompt);
@@ -333,7 +2639,11 @@ void handleSaveCircuit(const Circuit& circuit);
 void handleLoadCircuit(Circuit& circuit);
 void handleNewCircuit(CircuitManager& manager);
 void handleDisplayAndSelectCircuits(CircuitManager& manager);
+void handleTransientAnalysisOnAll(CircuitManager& manager);
+void handleTransientSettings(Circuit& circuit);
 
+// tests/engine_tests.cpp builds this file with CIRCUIT_NO_MAIN and its own main.
+#ifndef CIRCUIT_NO_MAIN
 int main() {
     CircuitManager myCircuitManager;
     myCircuitManager.createNewCircuit();
@@ -363,7 +2673,12 @@ int main() {
                 bool sub_menu_running = true;
                 while(sub_menu_running) {
                     cout << "\n--- DC Voltage Sweep Analysis ---" << endl;
+                    string sourceName;
                     double startVoltage, endVoltage, stepVoltage;
+                    if (!safelyReadString(sourceName, "Enter voltage source name, blank for the first DC source (or 'b' to go back to main menu): ")) {
+                        sub_menu_running = false;
+                        break;
+                    }
                     if (!safelyReadDouble(startVoltage, "Enter start voltage (or 'b' to go back to main menu): ")) {
                         sub_menu_running = false;
                         break;
@@ -376,7 +2691,7 @@ int main() {
                         sub_menu_running = false;
                         break;
                     }
-                    activeCircuit->simulateDCVoltageSweep(startVoltage, endVoltage, stepVoltage);
+                    activeCircuit->simulateDCVoltageSweep(startVoltage, endVoltage, stepVoltage, sourceName);
                     pauseSystem();
                     sub_menu_running = false;
                 }
@@ -386,7 +2701,12 @@ int main() {
                 bool sub_menu_running = true;
                 while(sub_menu_running) {
                     cout << "\n--- DC Current Sweep Analysis ---" << endl;
+                    string sourceName;
                     double startCurrent, endCurrent, stepCurrent;
+                    if (!safelyReadString(sourceName, "Enter current source name, blank for the first DC source (or 'b' to go back to main menu): ")) {
+                        sub_menu_running = false;
+                        break;
+                    }
                     if (!safelyReadDouble(startCurrent, "Enter start current (or 'b' to go back to main menu): ")) {
                         sub_menu_running = false;
                         break;
@@ -399,7 +2719,7 @@ int main() {
                         sub_menu_running = false;
                         break;
                     }
-                    activeCircuit->simulateDCCurrentSweep(startCurrent, endCurrent, stepCurrent);
+                    activeCircuit->simulateDCCurrentSweep(startCurrent, endCurrent, stepCurrent, sourceName);
                     pauseSystem();
                     sub_menu_running = false;
                 }
@@ -409,12 +2729,17 @@ int main() {
             case 12: handleRenameNode(*activeCircuit); break;
             case 13: handleSaveCircuit(*activeCircuit); pauseSystem(); break;
             case 14: handleLoadCircuit(*activeCircuit); pauseSystem(); break;
-            case 15: running = false; cout << "Exiting..." << endl; break;
+            case 15: handleParameterSweep(*activeCircuit); break;
+            case 16: handleMultiSourceSweep(*activeCircuit); break;
+            case 17: handleTransientAnalysisOnAll(myCircuitManager); break;
+            case 18: handleTransientSettings(*activeCircuit); break;
+            case 19: running = false; cout << "Exiting..." << endl; break;
             default: cout << "Invalid choice. Please try again." << endl; pauseSystem(); break;
         }
     }
     return 0;
 }
+#endif
 
 void displayMenu(const CircuitManager& manager) {
     cout << "\n--- Circuit Simulator Menu ---" << endl;
@@ -438,7 +2763,11 @@ void displayMenu(const CircuitManager& manager) {
     cout << "12. Rename Node in Active Circuit" << endl;
     cout << "13. Save Active Circuit" << endl;
     cout << "14. Load Circuit (into current active circuit)" << endl;
-    cout << "15. Exit" << endl;
+    cout << "15. Perform Component Value Sweep on Active Circuit" << endl;
+    cout << "16. Perform Multi-Source DC Sweep on Active Circuit" << endl;
+    cout << "17. Perform Transient Analysis on All Circuits" << endl;
+    cout << "18. Configure Transient Analysis for Active Circuit" << endl;
+    cout << "19. Exit" << endl;
     cout << "Enter your choice: ";
 }
 
@@ -570,11 +2899,13 @@ void handleRenameNode(Circuit& circuit) {
 }
 
 void Circuit::addElement(unique_ptr<Component> newComponent) {
-    components.push_back(move(newComponent));
+    nodeNumbering.addReference(newComponent->getNode1());
+    nodeNumbering.addReference(newComponent->getNode2());
+    editStructure().add(*newComponent);
 }
 
 void Circuit::displayCircuit() const {
-    if (components.empty()) {
+    if (elements->size() == 0) {
         cout << "Circuit '" << circuitName << "' is empty." << endl;
         return;
     }
@@ -587,303 +2918,288 @@ void Circuit::displayCircuit() const {
     }
     cout << "--------------------------------------------------------" << endl;
 
-    for (const auto& comp : components) {
-        comp->display();
+    for (int id = 0; id < elements->size(); ++id) {
+        elements->element(id)->display();
     }
     cout << "--------------------------------------------------------" << endl;
 }
 
 bool Circuit::setupAndSolveMNA(double time, double timeStep) {
+    if (context) context->solutionValid = false;
     if (!hasGround()) {
         cout << "Error: Circuit must have a ground node (0) for simulation." << endl;
-        nodeVoltages.clear();
-        componentCurrents.clear();
         return false;
     }
-
-    set<int> all_nodes = getAllNodes();
-    int max_node = 0;
-    if (!all_nodes.empty()){
-        max_node = *all_nodes.rbegin();
-    }
-
-    if (max_node == 0 && all_nodes.size() <= 1) {
-        nodeVoltages[0] = 0.0;
-        componentCurrents.clear();
-        return true;
-    }
-
-    int num_active_nodes = 0;
-    map<int, int> node_to_index;
-    vector<int> active_nodes_list;
-    for (int node : all_nodes) {
-        if (node != 0) {
-            node_to_index[node] = num_active_nodes++;
-            active_nodes_list.push_back(node);
-        }
-    }
-
-    int num_voltage_sources = 0;
-    for (const auto& comp : components) {
-        if (dynamic_cast<VoltageSource*>(comp.get())) {
-            num_voltage_sources++;
-        }
-    }
-
-    int total_equations = num_active_nodes + num_voltage_sources;
-    if (total_equations == 0) {
-        nodeVoltages.clear();
-        componentCurrents.clear();
-        if (all_nodes.count(0)) nodeVoltages[0] = 0.0;
-        return true;
+    if (!validateTopology().isValid()) {
+        checkTopology();
+        return false;
     }
+    return getContext().solveStep(time, timeStep);
+}
 
-    Eigen::MatrixXd G(total_equations, total_equations);
-    Eigen::VectorXd B(total_equations);
-    G.setZero();
-    B.setZero();
+void Circuit::resetSolution() {
+    getContext().resetSolution();
+}
 
-    int current_vs_idx = 0;
-    for (const auto& comp : components) {
-        int n1 = comp->getNode1();
-        int n2 = comp->getNode2();
+double Circuit::getComponentCurrent(const string& name) const {
+    return getComponentCurrent(getCompactNetlist().find(name));
+}
 
-        int idx1 = (n1 != 0 && node_to_index.count(n1)) ? node_to_index[n1] : -1;
-        int idx2 = (n2 != 0 && node_to_index.count(n2)) ? node_to_index[n2] : -1;
+double Circuit::getComponentCurrent(int id) const {
+    return context ? context->componentCurrent(id) : 0.0;
+}
 
-        if (auto res = dynamic_cast<Resistor*>(comp.get())) {
-            double conductance = 1.0 / res->getResistance();
-            if (idx1 != -1) G(idx1, idx1) += conductance;
-            if (idx2 != -1) G(idx2, idx2) += conductance;
-            if (idx1 != -1 && idx2 != -1) {
-                G(idx1, idx2) -= conductance;
-                G(idx2, idx1) -= conductance;
-            }
-        } else if (auto cap = dynamic_cast<Capacitor*>(comp.get())) {
-            double G_c = 1e-12;
-            if (timeStep > 0 && cap->getCapacitance() > 0) {
-                G_c = cap->getCapacitance() / timeStep;
-                double v1_prev = previousNodeVoltages.count(n1) ? previousNodeVoltages.at(n1) : 0.0;
-                double v2_prev = previousNodeVoltages.count(n2) ? previousNodeVoltages.at(n2) : 0.0;
-                double Ieq = G_c * (v1_prev - v2_prev);
-                if (idx1 != -1) B(idx1) -= Ieq;
-                if (idx2 != -1) B(idx2) += Ieq;
-            }
-            if (idx1 != -1) G(idx1, idx1) += G_c;
-            if (idx2 != -1) G(idx2, idx2) += G_c;
-            if (idx1 != -1 && idx2 != -1) {
-                G(idx1, idx2) -= G_c;
-                G(idx2, idx1) -= G_c;
-            }
-        } else if (auto ind = dynamic_cast<Inductor*>(comp.get())) {
-            double G_l = 1e9;
-            if (timeStep > 0 && ind->getInductance() > 0) {
-                G_l = timeStep / ind->getInductance();
-                double i_prev = previousComponentCurrents.count(ind->getName()) ? previousComponentCurrents.at(ind->getName()) : 0.0;
-                if (idx1 != -1) B(idx1) -= i_prev;
-                if (idx2 != -1) B(idx2) += i_prev;
-            }
-            if (idx1 != -1) G(idx1, idx1) += G_l;
-            if (idx2 != -1) G(idx2, idx2) += G_l;
-            if (idx1 != -1 && idx2 != -1) {
-                G(idx1, idx2) -= G_l;
-                G(idx2, idx1) -= G_l;
-            }
-        } else if (auto vs = dynamic_cast<VoltageSource*>(comp.get())) {
-            int vs_eq_idx = num_active_nodes + current_vs_idx;
-            if (idx1 != -1) {
-                G(idx1, vs_eq_idx) += 1.0;
-                G(vs_eq_idx, idx1) += 1.0;
-            }
-            if (idx2 != -1) {
-                G(idx2, vs_eq_idx) -= 1.0;
-                G(vs_eq_idx, idx2) -= 1.0;
-            }
-            B(vs_eq_idx) += vs->getValueAtTime(time);
-            current_vs_idx++;
-        } else if (auto cs = dynamic_cast<CurrentSource*>(comp.get())) {
-            double current_val = cs->getValueAtTime(time);
-            if (idx1 != -1) B(idx1) -= current_val;
-            if (idx2 != -1) B(idx2) += current_val;
-        }
+void Circuit::printSolution() const {
+    if (context) {
+        printSolution(*context);
+    } else {
+        printSolution(SimulationContext(getSnapshot()));
     }
+}
 
-    Eigen::VectorXd X;
-    if (G.determinant() == 0) {
-        cout << "Error: Circuit matrix is singular. Cannot be solved. Check for floating nodes or invalid connections." << endl;
-        nodeVoltages.clear();
-        componentCurrents.clear();
-        return false;
+void Circuit::printSolution(const SimulationContext& run) const {
+    vector<pair<int, int>> nodes;
+    nodes.emplace_back(0, -1);
+    const vector<int>& nodeNumbers = run.getProgram().nodeNumbers;
+    for (int i = 0; i < (int)nodeNumbers.size(); ++i) {
+        nodes.emplace_back(nodeNumbers[i], i);
     }
-    X = G.lu().solve(B);
+    sort(nodes.begin(), nodes.end());
 
-    nodeVoltages.clear();
-    nodeVoltages[0] = 0.0;
-    for (int i = 0; i < num_active_nodes; ++i) {
-        nodeVoltages[active_nodes_list[i]] = X(i);
+    cout << "  Node Voltages:" << endl;
+    for (auto const& [node, idx] : nodes) {
+        double voltage = (idx < 0 || !run.solutionValid) ? 0.0 : run.solution(idx);
+        cout << "    Node " << node << ": " << scientific << setprecision(4) << voltage << " V" << endl;
     }
 
-    current_vs_idx = 0;
-    componentCurrents.clear();
-    for (const auto& comp : components) {
-        if (auto vs = dynamic_cast<VoltageSource*>(comp.get())) {
-            int vs_eq_idx = num_active_nodes + current_vs_idx;
-            componentCurrents[vs->getName()] = X(vs_eq_idx);
-            current_vs_idx++;
-        } else if (auto res = dynamic_cast<Resistor*>(comp.get())) {
-            double v1 = getNodeVoltage(res->getNode1());
-            double v2 = getNodeVoltage(res->getNode2());
-            componentCurrents[res->getName()] = (v1 - v2) / res->getResistance();
-        } else if (auto cap = dynamic_cast<Capacitor*>(comp.get())) {
-            if (timeStep > 0 && cap->getCapacitance() > 0) {
-                double v1_prev = previousNodeVoltages.count(cap->getNode1()) ? previousNodeVoltages.at(cap->getNode1()) : 0.0;
-                double v2_prev = previousNodeVoltages.count(cap->getNode2()) ? previousNodeVoltages.at(cap->getNode2()) : 0.0;
-                double v1_now = getNodeVoltage(cap->getNode1());
-                double v2_now = getNodeVoltage(cap->getNode2());
-                componentCurrents[cap->getName()] = (cap->getCapacitance() / timeStep) * ((v1_now - v2_now) - (v1_prev - v2_prev));
-            } else {
-                componentCurrents[cap->getName()] = 0.0;
-            }
-        }
+    cout << "  Component Currents:" << endl;
+    const CompactNetlist& netlist = *run.getSnapshot().netlist;
+    for (int id = 0; id < netlist.size(); ++id) {
+        double current = run.componentCurrent(id);
+        cout << "    " << netlist.names.name(id) << " (" << componentTypeName(netlist.types[id]) << "): "
+             << scientific << setprecision(4) << current << " A" << endl;
     }
-
-    return true;
 }
 
-double Circuit::getNodeVoltage(int node) const {
-    if (nodeVoltages.count(node)) {
-        return nodeVoltages.at(node);
-    }
-    return 0.0;
-}
 
-double Circuit::getComponentCurrent(const string& name) const {
-    if (componentCurrents.count(name)) {
-        return componentCurrents.at(name);
-    }
-    return 0.0;
+void Circuit::runTransientAnalysis(double startTime, double endTime, double timeStep) {
+    TransientPrinter printer(cout);
+    computeTransient(startTime, endTime, timeStep, printer);
 }
 
-
-void Circuit::runTransientAnalysis(double startTime, double endTime, double timeStep) {
+// Runs on a private context over the current snapshot and reports through
+// `log`, so circuits can be simulated on different threads at once. Returns
+// false if the run stopped early; rows up to that point still reach the sink,
+// which is always ended once begun.
+bool Circuit::computeTransient(double startTime, double endTime, double timeStep, TransientSink& sink, ostream& log) {
+    NoHeapAllocationScope::Analysis analysis;
     if (!hasGround()) {
-        cout << "Error: Circuit must have a ground node (0) for analysis." << endl;
-        return;
+        log << "Error: Circuit must have a ground node (0) for analysis." << endl;
+        return false;
+    }
+    if (!checkTopology(log)) {
+        return false;
     }
     if (timeStep <= 0) {
-        cout << "Error: Time step must be a positive number." << endl;
-        return;
+        log << "Error: Time step must be a positive number." << endl;
+        return false;
     }
 
-    map<int, int> nodeMap;
-    int nodeCount = 0;
-    for (const auto& comp : components) {
-        if (comp->getNode1() != 0 && nodeMap.find(comp->getNode1()) == nodeMap.end()) {
-            nodeMap[comp->getNode1()] = ++nodeCount;
-        }
-        if (comp->getNode2() != 0 && nodeMap.find(comp->getNode2()) == nodeMap.end()) {
-            nodeMap[comp->getNode2()] = ++nodeCount;
+    SimulationContext run = seedContext();
+    run.setDiagnostics(log);
+    run.setIntegrationMethod(transientOptions.method);
+    const NameTable& names = run.getSnapshot().netlist->names;
+    const StampProgram& program = run.getProgram();
+    int matrixSize = program.size();
+    if (matrixSize <= 0) {
+        log << "Circuit has no unknowns to solve for." << endl;
+        return false;
+    }
+    Eigen::VectorXd x = Eigen::VectorXd::Zero(matrixSize + 1);
+
+    auto byName = [&names](const BranchStamp& lhs, const BranchStamp& rhs) {
+        return names.name(lhs.component) < names.name(rhs.component);
+    };
+    vector<int> reported(program.nodeCount);
+    for (int i = 0; i < program.nodeCount; ++i) reported[i] = i;
+    sort(reported.begin(), reported.end(), [&program](int lhs, int rhs) {
+        return program.nodeNumbers[lhs] < program.nodeNumbers[rhs];
+    });
+    vector<string> labels;
+    for (int i : reported) labels.push_back("V(node " + to_string(program.nodeNumbers[i]) + ")");
+    for (auto branches : {program.inductors, program.voltageSources}) {
+        sort(branches.begin(), branches.end(), byName);
+        for (const auto& branch : branches) {
+            reported.push_back(branch.branch);
+            labels.push_back("I(" + string(names.name(branch.component)) + ")");
         }
     }
+    Eigen::VectorXd values(reported.size());
 
-    map<string, int> inductorMap;
-    int inductorCount = 0;
-    map<string, int> voltageSourceMap;
-    int voltageSourceCount = 0;
-
-    for (const auto& comp : components) {
-        if (dynamic_cast<Inductor*>(comp.get())) {
-            inductorMap[comp->getName()] = inductorCount++;
-        } else if (dynamic_cast<VoltageSource*>(comp.get())) {
-            voltageSourceMap[comp->getName()] = voltageSourceCount++;
+    sink.begin(labels);
+    if (transientOptions.adaptive) {
+        bool completed = stepAdaptively(run, startTime, endTime, timeStep, reported, sink, log);
+        sink.end();
+        return completed;
+    }
+    double time = startTime;
+    if (transientOptions.startFromOperatingPoint) {
+        if (!run.solveOperatingPoint(startTime)) {
+            sink.end();
+            return false;
         }
+        x = run.solution;
+        for (size_t i = 0; i < reported.size(); ++i) values(i) = x(reported[i]);
+        sink.row(startTime, values);
+        time += timeStep;
+    } else if (!run.factor(timeStep)) {
+        // With a fixed step the matrix changes only when Gear switches order,
+        // so most steps are just a forward/back substitution.
+        sink.end();
+        return false;
     }
-
-    int matrixSize = nodeCount + inductorCount + voltageSourceCount;
-    if (matrixSize <= 0) {
-        cout << "Circuit has no unknowns to solve for." << endl;
-        return;
+    bool completed = true;
+    for (; time <= endTime; time += timeStep) {
+        // Only the step itself is held allocation-free; the sink is user code.
+        {
+            NoHeapAllocationScope noAllocation(run.stepsWithoutAllocation());
+            if (!run.factor(timeStep)) {
+                completed = false;
+                break;
+            }
+            run.assembleRhs(time, x);
+            run.solve(x);
+            run.acceptStep(x);
+        }
+        for (size_t i = 0; i < reported.size(); ++i) values(i) = x(reported[i]);
+        sink.row(time, values);
     }
+    sink.end();
+    return completed;
+}
 
-    Eigen::VectorXd x_prev = Eigen::VectorXd::Zero(matrixSize);
-
-    cout << "--- Starting Transient Analysis ---" << endl;
-    cout << scientific << setprecision(6);
-
-    for (double time = startTime; time <= endTime; time += timeStep) {
-        Eigen::MatrixXd A = Eigen::MatrixXd::Zero(matrixSize, matrixSize);
-        Eigen::VectorXd z = Eigen::VectorXd::Zero(matrixSize);
-
-        for (const auto& comp : components) {
-            int n1 = comp->getNode1();
-            int n2 = comp->getNode2();
-            int mapped_n1 = (n1 == 0) ? -1 : nodeMap.at(n1) - 1;
-            int mapped_n2 = (n2 == 0) ? -1 : nodeMap.at(n2) - 1;
-
-            if (auto r = dynamic_cast<Resistor*>(comp.get())) {
-                double g = 1.0 / r->getResistance();
-                if (mapped_n1 != -1) A(mapped_n1, mapped_n1) += g;
-                if (mapped_n2 != -1) A(mapped_n2, mapped_n2) += g;
-                if (mapped_n1 != -1 && mapped_n2 != -1) {
-                    A(mapped_n1, mapped_n2) -= g;
-                    A(mapped_n2, mapped_n1) -= g;
-                }
-            }
-            else if (auto c = dynamic_cast<Capacitor*>(comp.get())) {
-                double c_h = c->getCapacitance() / timeStep;
-                if (mapped_n1 != -1) A(mapped_n1, mapped_n1) += c_h;
-                if (mapped_n2 != -1) A(mapped_n2, mapped_n2) += c_h;
-                if (mapped_n1 != -1 && mapped_n2 != -1) {
-                    A(mapped_n1, mapped_n2) -= c_h;
-                    A(mapped_n2, mapped_n1) -= c_h;
-                }
-                double v_prev = (mapped_n1 != -1 ? x_prev(mapped_n1) : 0.0) - (mapped_n2 != -1 ? x_prev(mapped_n2) : 0.0);
-                double ic_prev = c_h * v_prev;
-                if (mapped_n1 != -1) z(mapped_n1) += ic_prev;
-                if (mapped_n2 != -1) z(mapped_n2) -= ic_prev;
-            }
-            else if (auto l = dynamic_cast<Inductor*>(comp.get())) {
-                int l_idx = nodeCount + inductorMap.at(l->getName());
-                double l_h = l->getInductance() / timeStep;
-                if (mapped_n1 != -1) A(mapped_n1, l_idx) += 1.0;
-                if (mapped_n2 != -1) A(mapped_n2, l_idx) -= 1.0;
-                if (mapped_n1 != -1) A(l_idx, mapped_n1) += 1.0;
-                if (mapped_n2 != -1) A(l_idx, mapped_n2) -= 1.0;
-                A(l_idx, l_idx) -= l_h;
-                z(l_idx) -= l_h * x_prev(l_idx);
-            }
-            else if (auto vs = dynamic_cast<VoltageSource*>(comp.get())) {
-                int vs_idx = nodeCount + inductorCount + voltageSourceMap.at(vs->getName());
-                if (mapped_n1 != -1) A(mapped_n1, vs_idx) += 1.0;
-                if (mapped_n2 != -1) A(mapped_n2, vs_idx) -= 1.0;
-                if (mapped_n1 != -1) A(vs_idx, mapped_n1) += 1.0;
-                if (mapped_n2 != -1) A(vs_idx, mapped_n2) -= 1.0;
-                z(vs_idx) += vs->getValueAtTime(time);
-            }
-            else if (auto cs = dynamic_cast<CurrentSource*>(comp.get())) {
-                double i_val = cs->getValueAtTime(time);
-                if (mapped_n1 != -1) z(mapped_n1) -= i_val;
-                if (mapped_n2 != -1) z(mapped_n2) += i_val;
+// Error-controlled stepping for computeTransient. A step whose truncation
+// error estimate exceeds the tolerances is rejected and retried shorter;
+// accepted steps set the next step from the estimate, within the growth and
+// shrink limits. Steps land exactly on source breakpoints and stay below the
+// sources' safe step. Rows for the output grid startTime + k * outputStep are
+// interpolated through the last three accepted points.
+bool Circuit::stepAdaptively(SimulationContext& run, double startTime, double endTime, double outputStep,
+                             const vector<int>& reported, TransientSink& sink, ostream& log) {
+    const TransientOptions& options = transientOptions;
+    run.setErrorTolerances(options.relativeTolerance, options.absoluteTolerance);
+    double span = max(0.0, endTime - startTime);
+    double maxStep = min(options.maxStep > 0 ? options.maxStep : span / 50, run.maxSourceStep());
+    double minStep = max(span, outputStep) * 1e-12;
+    double gridTolerance = outputStep * 1e-9;
+    double step = min(outputStep, maxStep > 0 ? maxStep : outputStep) * 1e-3;
+
+    int n = run.size();
+    int m = reported.size();
+    Eigen::VectorXd current = Eigen::VectorXd::Zero(n + 1);
+    Eigen::VectorXd candidate = Eigen::VectorXd::Zero(n + 1);
+    Eigen::VectorXd values(m);
+    // Reported values at the last three accepted times, newest first.
+    Eigen::VectorXd points[3] = {Eigen::VectorXd::Zero(m), Eigen::VectorXd::Zero(m), Eigen::VectorXd::Zero(m)};
+    double pointTimes[3] = {};
+    int pointCount = 0;
+    auto record = [&](double time) {
+        points[2].swap(points[1]);
+        points[1].swap(points[0]);
+        for (int i = 0; i < m; ++i) points[0](i) = current(reported[i]);
+        pointTimes[2] = pointTimes[1];
+        pointTimes[1] = pointTimes[0];
+        pointTimes[0] = time;
+        pointCount = min(pointCount + 1, 3);
+    };
+    auto interpolate = [&](double t) {
+        double t0 = pointTimes[0], t1 = pointTimes[1], t2 = pointTimes[2];
+        if (pointCount < 2) {
+            values = points[0];
+        } else if (pointCount < 3) {
+            values = ((t - t1) / (t0 - t1)) * points[0] + ((t - t0) / (t1 - t0)) * points[1];
+        } else {
+            values = ((t - t1) * (t - t2) / ((t0 - t1) * (t0 - t2))) * points[0] +
+                     ((t - t0) * (t - t2) / ((t1 - t0) * (t1 - t2))) * points[1] +
+                     ((t - t0) * (t - t1) / ((t2 - t0) * (t2 - t1))) * points[2];
+        }
+    };
+
+    // Without the operating point the first point is one short step from the
+    // zero state, as the first fixed step is; it is reported at startTime.
+    long long acceptedSteps = 0, rejectedSteps = 0;
+    if (options.startFromOperatingPoint) {
+        if (!run.solveOperatingPoint(startTime)) return false;
+        current = run.solution;
+    } else {
+        if (!run.factor(step)) return false;
+        run.assembleRhs(startTime, current);
+        run.solve(candidate);
+        run.acceptStep(candidate);
+        current.swap(candidate);
+        ++acceptedSteps;
+    }
+    record(startTime);
+    sink.row(startTime, points[0]);
+
+    long long gridIndex = 1;
+    double time = startTime;
+    double breakpoint = run.nextBreakpoint(time);
+    bool ok = true;
+    while (time < endTime) {
+        if (maxStep > 0) step = min(step, maxStep);
+        // Land on the next breakpoint or endTime; split the distance in two
+        // rather than leave a sliver in front of it.
+        double target = min(breakpoint, endTime);
+        bool landing = step >= target - time;
+        double h = landing ? target - time : step;
+        if (!landing && 2 * step > target - time) h = (target - time) / 2;
+        double error;
+        {
+            NoHeapAllocationScope noAllocation(run.stepsWithoutAllocation());
+            if (!run.factor(h)) {
+                ok = false;
+                break;
             }
+            run.assembleRhs(landing ? target : time + h, current);
+            run.solve(candidate);
+            error = run.truncationError(candidate);
         }
-
-        Eigen::VectorXd x_t = A.colPivHouseholderQr().solve(z);
-
-        cout << "\nTime: " << time << "s" << endl;
-        for (auto const& [node_num, matrix_idx] : nodeMap) {
-            cout << "  V(node " << node_num << "): " << x_t(matrix_idx - 1) << " V" << endl;
+        double exponent = -1.0 / (run.integrationOrder() + 1);
+        if (error > 1.0) {
+            ++rejectedSteps;
+            step = h * max(options.stepShrinkLimit, 0.9 * pow(error, exponent));
+            if (step < minStep) {
+                log << "Error: Time step fell below " << minStep << "s at t = " << time
+                    << "s. Loosen the tolerances or check the circuit." << endl;
+                ok = false;
+                break;
+            }
+            continue;
         }
-        for (auto const& [l_name, matrix_idx] : inductorMap) {
-            cout << "  I(" << l_name << "): " << x_t[nodeCount + matrix_idx] << " A" << endl;
+        {
+            NoHeapAllocationScope noAllocation(run.stepsWithoutAllocation());
+            run.acceptStep(candidate);
+            current.swap(candidate);
+            time = landing ? target : time + h;
+            record(time);
         }
-        for (auto const& [vs_name, matrix_idx] : voltageSourceMap) {
-            cout << "  I(" << vs_name << "): " << x_t[nodeCount + inductorCount + matrix_idx] << " A" << endl;
+        if (landing && time < endTime) breakpoint = run.nextBreakpoint(time);
+        ++acceptedSteps;
+        for (double t = startTime + gridIndex * outputStep; t <= time + gridTolerance && t <= endTime + gridTolerance;
+             t = startTime + ++gridIndex * outputStep) {
+            interpolate(t);
+            sink.row(t, values);
         }
-
-        x_prev = x_t;
+        double growth = error < 0 ? 1.0 : error == 0 ? options.stepGrowthLimit : 0.9 * pow(error, exponent);
+        // A step cut short by a breakpoint says nothing against the longer one.
+        double proposal = h * min(options.stepGrowthLimit, growth);
+        step = h < step ? max(step, proposal) : proposal;
     }
-    cout << "--- Transient Analysis Finished ---" << endl;
+    log << "Adaptive stepping: " << acceptedSteps << " steps accepted, " << rejectedSteps << " rejected." << endl;
+    return ok;
 }
+
 void Circuit::simulateMultipleVariables(double startTime, double endTime, double timeStep) {
     if (timeStep <= 0) {
         cout << "Error: Time step must be a positive value." << endl;
@@ -897,45 +3213,38 @@ void Circuit::simulateMultipleVariables(double startTime, double endTime, double
         cout << "Error: Circuit must have a ground node (0) for simulation." << endl;
         return;
     }
-
-    nodeVoltages.clear();
-    componentCurrents.clear();
-    previousNodeVoltages.clear();
-    previousComponentCurrents.clear();
-    set<int> all_nodes = getAllNodes();
-    for(int node : all_nodes) {
-        previousNodeVoltages[node] = 0.0;
-    }
-    for(const auto& comp: components) {
-        previousComponentCurrents[comp->getName()] = 0.0;
+    if (!checkTopology()) {
+        return;
     }
 
+    resetSolution();
+
     cout << "\n--- Transient Simulation Results (All Variables) ---" << endl;
-    for (double time = startTime; time <= endTime + timeStep/2; time += timeStep) {
+    double time = startTime;
+    if (transientOptions.startFromOperatingPoint) {
+        cout << "\nTime: " << scientific << setprecision(4) << time << "s (operating point)" << endl;
+        if (!getContext().solveOperatingPoint(time)) {
+            cout << "Circuit analysis failed at the operating point." << endl;
+            cout << "--- Transient Simulation Finished ---" << endl;
+            return;
+        }
+        printSolution();
+        time += timeStep;
+    }
+    for (; time <= endTime + timeStep/2; time += timeStep) {
         cout << "\nTime: " << scientific << setprecision(4) << time << "s" << endl;
         if (!setupAndSolveMNA(time, timeStep)) {
             cout << "Circuit analysis failed at this time step." << endl;
             break;
         }
 
-        cout << "  Node Voltages:" << endl;
-        for (auto const& [node, voltage] : nodeVoltages) {
-            cout << "    Node " << node << ": " << scientific << setprecision(4) << voltage << " V" << endl;
-        }
-
-        cout << "  Component Currents:" << endl;
-        for (const auto& comp : components) {
-            double current = getComponentCurrent(comp->getName());
-            cout << "    " << comp->getName() << " (" << comp->getType() << "): "
-                 << scientific << setprecision(4) << current << " A" << endl;
-        }
-        previousNodeVoltages = nodeVoltages;
-        previousComponentCurrents = componentCurrents;
+        printSolution();
     }
     cout << "--- Transient Simulation Finished ---" << endl;
 }
 
-void Circuit::simulateDCVoltageSweep(double startVoltage, double endVoltage, double stepVoltage) {
+void Circuit::simulateDCVoltageSweep(double startVoltage, double endVoltage, double stepVoltage, const string& sourceName) {
+    NoHeapAllocationScope::Analysis analysis;
     if (stepVoltage == 0) {
         cout << "Error: Voltage step for sweep cannot be zero." << endl;
         return;
@@ -948,50 +3257,57 @@ void Circuit::simulateDCVoltageSweep(double startVoltage, double endVoltage, dou
         cout << "Error: Circuit must have a ground node (0) for simulation." << endl;
         return;
     }
+    if (!checkTopology()) {
+        return;
+    }
 
-    VoltageSource* sweepSource = nullptr;
-    for (const auto& comp : components) {
-        if (auto vs = dynamic_cast<VoltageSource*>(comp.get())) {
-            if (vs->getWaveformType() == VoltageSource::Waveform::DC) {
-                sweepSource = vs;
-                break;
-            }
+    const CompactNetlist& netlist = getCompactNetlist();
+    int sweepId = -1;
+    if (!sourceName.empty()) {
+        sweepId = netlist.find(sourceName);
+        if (sweepId == -1 || netlist.types[sweepId] != ComponentType::VOLTAGE_SOURCE) {
+            cout << "Error: Voltage source '" << sourceName << "' not found." << endl;
+            return;
+        }
+    }
+    for (int id = 0; sweepId == -1 && id < netlist.size(); ++id) {
+        if (netlist.types[id] == ComponentType::VOLTAGE_SOURCE && !netlist.voltageSources.sine[netlist.positions[id]]) {
+            sweepId = id;
         }
     }
 
-    if (!sweepSource) {
+    if (sweepId == -1) {
         cout << "No DC voltage source found in the circuit to perform DC sweep. Please add one." << endl;
         return;
     }
 
-    double originalVoltage = sweepSource->getValueAtTime(0);
     double currentVoltage = startVoltage;
 
-    cout << "\n--- DC Voltage Sweep Results (Sweeping " << sweepSource->getName() << ") ---" << endl;
+    string sweepName(netlist.names.name(sweepId));
+    cout << "\n--- DC Voltage Sweep Results (Sweeping " << sweepName << ") ---" << endl;
+    SimulationContext sweep = seedContext();
+    const SourceStamp sweepStamp = sweep.source(sweepId);
+    Eigen::VectorXd base;
+    Eigen::MatrixXd response;
+    if (!sweep.solveDCSourceResponses({sweepId}, base, response)) {
+        cout << "Circuit analysis failed. Aborting sweep." << endl;
+        cout << "--- DC Voltage Sweep Finished ---" << endl;
+        return;
+    }
     while ((stepVoltage > 0 && currentVoltage <= endVoltage + stepVoltage/2) || (stepVoltage < 0 && currentVoltage >= endVoltage + stepVoltage/2)) {
-        sweepSource->setDCOffsetValue(currentVoltage);
-        cout << "\nSweep Voltage (" << sweepSource->getName() << "): " << scientific << setprecision(4) << currentVoltage << "V" << endl;
-        if (!setupAndSolveMNA(0, 0.0)) {
-            cout << "Circuit analysis failed for this voltage step. Aborting sweep." << endl;
-            break;
-        }
-        cout << "  Node Voltages:" << endl;
-        for (auto const& [node, voltage] : nodeVoltages) {
-            cout << "    Node " << node << ": " << scientific << setprecision(4) << voltage << " V" << endl;
-        }
-        cout << "  Component Currents:" << endl;
-        for (const auto& comp : components) {
-            double current = getComponentCurrent(comp->getName());
-            cout << "    " << comp->getName() << " (" << comp->getType() << "): "
-                 << scientific << setprecision(4) << current << " A" << endl;
-        }
+        sweep.setSource(sweepId, currentVoltage, sweepStamp.amplitude, sweepStamp.frequency);
+        cout << "\nSweep Voltage (" << sweepName << "): " << scientific << setprecision(4) << currentVoltage << "V" << endl;
+        sweep.solution = base + currentVoltage * response.col(0);
+        sweep.solutionTime = 0.0;
+        sweep.solutionValid = true;
+        printSolution(sweep);
         currentVoltage += stepVoltage;
     }
-    sweepSource->setDCOffsetValue(originalVoltage);
     cout << "--- DC Voltage Sweep Finished ---" << endl;
 }
 
-void Circuit::simulateDCCurrentSweep(double startCurrent, double endCurrent, double stepCurrent) {
+void Circuit::simulateDCCurrentSweep(double startCurrent, double endCurrent, double stepCurrent, const string& sourceName) {
+    NoHeapAllocationScope::Analysis analysis;
     if (stepCurrent == 0) {
         cout << "Error: Current step for sweep cannot be zero." << endl;
         return;
@@ -1004,95 +3320,543 @@ void Circuit::simulateDCCurrentSweep(double startCurrent, double endCurrent, dou
         cout << "Error: Circuit must have a ground node (0) for simulation." << endl;
         return;
     }
+    if (!checkTopology()) {
+        return;
+    }
 
-    CurrentSource* sweepSource = nullptr;
-    for (const auto& comp : components) {
-        if (auto cs = dynamic_cast<CurrentSource*>(comp.get())) {
-            if (cs->getWaveformType() == CurrentSource::Waveform::DC) {
-                sweepSource = cs;
-                break;
-            }
+    const CompactNetlist& netlist = getCompactNetlist();
+    int sweepId = -1;
+    if (!sourceName.empty()) {
+        sweepId = netlist.find(sourceName);
+        if (sweepId == -1 || netlist.types[sweepId] != ComponentType::CURRENT_SOURCE) {
+            cout << "Error: Current source '" << sourceName << "' not found." << endl;
+            return;
+        }
+    }
+    for (int id = 0; sweepId == -1 && id < netlist.size(); ++id) {
+        if (netlist.types[id] == ComponentType::CURRENT_SOURCE && !netlist.currentSources.sine[netlist.positions[id]]) {
+            sweepId = id;
         }
     }
 
-    if (!sweepSource) {
+    if (sweepId == -1) {
         cout << "No DC current source found in the circuit to perform DC sweep. Please add one." << endl;
         return;
     }
 
-    double originalCurrent = sweepSource->getValueAtTime(0);
     double currentSweepValue = startCurrent;
 
-    cout << "\n--- DC Current Sweep Results (Sweeping " << sweepSource->getName() << ") ---" << endl;
+    string sweepName(netlist.names.name(sweepId));
+    cout << "\n--- DC Current Sweep Results (Sweeping " << sweepName << ") ---" << endl;
+    SimulationContext sweep = seedContext();
+    const SourceStamp sweepStamp = sweep.source(sweepId);
+    Eigen::VectorXd base;
+    Eigen::MatrixXd response;
+    if (!sweep.solveDCSourceResponses({sweepId}, base, response)) {
+        cout << "Circuit analysis failed. Aborting sweep." << endl;
+        cout << "--- DC Current Sweep Finished ---" << endl;
+        return;
+    }
     while ((stepCurrent > 0 && currentSweepValue <= endCurrent + stepCurrent / 2) || (stepCurrent < 0 && currentSweepValue >= endCurrent + stepCurrent / 2)) {
-        sweepSource->setDCOffsetValue(currentSweepValue);
-        cout << "\nSweep Current (" << sweepSource->getName() << "): " << scientific << setprecision(4) << currentSweepValue << " A" << endl;
-        if (!setupAndSolveMNA(0, 0.0)) {
-            cout << "Circuit analysis failed for this current step. Aborting sweep." << endl;
+        sweep.setSource(sweepId, currentSweepValue, sweepStamp.amplitude, sweepStamp.frequency);
+        cout << "\nSweep Current (" << sweepName << "): " << scientific << setprecision(4) << currentSweepValue << " A" << endl;
+        sweep.solution = base + currentSweepValue * response.col(0);
+        sweep.solutionTime = 0.0;
+        sweep.solutionValid = true;
+        printSolution(sweep);
+        currentSweepValue += stepCurrent;
+    }
+    cout << "--- DC Current Sweep Finished ---" << endl;
+}
+
+// Sweeps one R, C or L value on a private simulation context. With timeStep 0
+// every point is a DC solve, so only R values may be swept; C and L only enter
+// the matrix through their companion models and need timeStep > 0, in which
+// case every point is a fixed-step transient from rest up to endTime that
+// reports the state there. Under backward Euler and trapezoidal the companion
+// step never changes, so all points share the factorization taken at the
+// first point and each new value is a rank-1 update of it. Gear restarts every
+// point at BDF1 and moves to BDF2, whose companion coefficient differs, so
+// each point there pays two full factorizations.
+void Circuit::simulateParameterSweep(const string& componentName, double startValue, double endValue, double stepValue,
+                                     double timeStep, double endTime) {
+    NoHeapAllocationScope::Analysis analysis;
+    int sweepId = getCompactNetlist().find(componentName);
+    if (sweepId == -1) {
+        cout << "Error: Component '" << componentName << "' not found." << endl;
+        return;
+    }
+    string unit;
+    ComponentType type = getCompactNetlist().types[sweepId];
+    if (type == ComponentType::RESISTOR) {
+        unit = "Ohm";
+    } else if (type == ComponentType::CAPACITOR) {
+        unit = "F";
+    } else if (type == ComponentType::INDUCTOR) {
+        unit = "H";
+    } else {
+        cout << "Error: Only resistor, capacitor and inductor values can be swept." << endl;
+        return;
+    }
+    if (stepValue == 0) {
+        cout << "Error: Value step for sweep cannot be zero." << endl;
+        return;
+    }
+    if ((startValue < endValue && stepValue < 0) || (startValue > endValue && stepValue > 0)) {
+        cout << "Error: Incorrect step direction for given start and end values." << endl;
+        return;
+    }
+    if (unit == "Ohm" && (startValue <= 0 || endValue <= 0)) {
+        cout << "Error: Swept resistance must stay positive." << endl;
+        return;
+    }
+    if (timeStep < 0) {
+        cout << "Error: Time step must not be negative." << endl;
+        return;
+    }
+    if (timeStep == 0 && unit != "Ohm") {
+        cout << "Error: Capacitors and inductors have no effect at DC. Sweep them with a time step and end time." << endl;
+        return;
+    }
+    if (timeStep > 0 && endTime < 0) {
+        cout << "Error: End time must not be negative." << endl;
+        return;
+    }
+    if (!hasGround()) {
+        cout << "Error: Circuit must have a ground node (0) for simulation." << endl;
+        return;
+    }
+    if (!checkTopology()) {
+        return;
+    }
+
+    SimulationContext sweep = seedContext();
+    sweep.setIntegrationMethod(transientOptions.method);
+    double currentValue = startValue;
+    cout << "\n--- Component Value Sweep Results (Sweeping " << componentName << ") ---" << endl;
+    while ((stepValue > 0 && currentValue <= endValue + stepValue / 2) || (stepValue < 0 && currentValue >= endValue + stepValue / 2)) {
+        sweep.setElementValue(sweepId, currentValue);
+        cout << "\nSweep Value (" << componentName << "): " << scientific << setprecision(4) << currentValue << " " << unit << endl;
+        sweep.resetSolution();
+        bool solved = true;
+        if (timeStep == 0) {
+            solved = sweep.solveStep(0, 0);
+        } else {
+            for (double time = 0; solved && time <= endTime + timeStep / 2; time += timeStep) {
+                solved = sweep.solveStep(time, timeStep);
+            }
+        }
+        if (!solved) {
+            cout << "Circuit analysis failed for this value. Aborting sweep." << endl;
             break;
         }
-        cout << "  Node Voltages:" << endl;
-        for (auto const& [node, voltage] : nodeVoltages) {
-            cout << "    Node " << node << ": " << scientific << setprecision(4) << voltage << " V" << endl;
+        if (timeStep > 0) cout << "  State at t = " << scientific << setprecision(4) << sweep.solutionTime << "s:" << endl;
+        printSolution(sweep);
+        currentValue += stepValue;
+    }
+    cout << "--- Component Value Sweep Finished ---" << endl;
+}
+
+
+// Sweeps the DC values of the named sources over the grid spanned by `axes`
+// and measures every probe at each point. A probe is "V(<node>)" for a node
+// voltage or "I(<element>)" for an element current; no probes means all node
+// voltages. Every probe is affine in the swept values, so the superposition
+// responses are first reduced to a base value and one slope per axis for each
+// probe. Pool workers then evaluate disjoint chunks of grid points against
+// those read-only tables, each writing only its own rows of the result; the
+// netlist is never modified.
+bool Circuit::sweepSources(const vector<SweepAxis>& axes, const vector<string>& probes, SweepResult& result,
+                           ThreadPool& pool) {
+    NoHeapAllocationScope::Analysis analysis;
+    if (!hasGround()) {
+        cout << "Error: Circuit must have a ground node (0) for simulation." << endl;
+        return false;
+    }
+    if (!checkTopology()) {
+        return false;
+    }
+    const CompactNetlist& netlist = getCompactNetlist();
+    vector<int> sourceIds;
+    vector<int> counts;
+    long long pointCount = 1;
+    for (const auto& axis : axes) {
+        int id = netlist.find(axis.source);
+        if (id == -1 || (netlist.types[id] != ComponentType::VOLTAGE_SOURCE && netlist.types[id] != ComponentType::CURRENT_SOURCE)) {
+            cout << "Error: '" << axis.source << "' is not a voltage or current source." << endl;
+            return false;
+        }
+        if (find(sourceIds.begin(), sourceIds.end(), id) != sourceIds.end()) {
+            cout << "Error: Source '" << axis.source << "' is swept more than once." << endl;
+            return false;
         }
-        cout << "  Component Currents:" << endl;
-        for (const auto& comp : components) {
-            double current = getComponentCurrent(comp->getName());
-            cout << "    " << comp->getName() << " (" << comp->getType() << "): "
-                 << scientific << setprecision(4) << current << " A" << endl;
+        if (axis.step == 0 || (axis.start < axis.end && axis.step < 0) || (axis.start > axis.end && axis.step > 0)) {
+            cout << "Error: Invalid sweep range for source '" << axis.source << "'." << endl;
+            return false;
+        }
+        sourceIds.push_back(id);
+        counts.push_back(axis.pointCount());
+        pointCount *= counts.back();
+        if (pointCount > numeric_limits<int>::max()) {
+            cout << "Error: Sweep grid is too large." << endl;
+            return false;
         }
-        currentSweepValue += stepCurrent;
     }
-    sweepSource->setDCOffsetValue(originalCurrent);
-    cout << "--- DC Current Sweep Finished ---" << endl;
+
+    SimulationContext run = seedContext();
+    Eigen::VectorXd base;
+    Eigen::MatrixXd responses;
+    if (!run.solveDCSourceResponses(sourceIds, base, responses)) {
+        return false;
+    }
+
+    result.sources.clear();
+    for (const auto& axis : axes) result.sources.push_back(axis.source);
+    result.probes = probes;
+    if (result.probes.empty()) {
+        vector<int> nodes = nodeNumbering.getNodeNumbers();
+        sort(nodes.begin(), nodes.end());
+        for (int node : nodes) result.probes.push_back("V(" + to_string(node) + ")");
+    }
+
+    // Probe j reads probeBase(j) + probeSlope.row(j) * v for swept values v.
+    const StampProgram& program = run.getProgram();
+    int axisCount = axes.size();
+    int probeCount = result.probes.size();
+    Eigen::VectorXd probeBase = Eigen::VectorXd::Zero(probeCount);
+    Eigen::MatrixXd probeSlope = Eigen::MatrixXd::Zero(probeCount, axisCount);
+    auto addTerm = [&](int j, int idx, double weight) {
+        probeBase(j) += weight * base(idx);
+        probeSlope.row(j) += weight * responses.row(idx);
+    };
+    for (int j = 0; j < probeCount; ++j) {
+        const string& probe = result.probes[j];
+        bool wellFormed = probe.size() > 3 && probe[1] == '(' && probe.back() == ')' &&
+                          (toupper(probe[0]) == 'V' || toupper(probe[0]) == 'I');
+        string target = wellFormed ? probe.substr(2, probe.size() - 3) : "";
+        if (wellFormed && toupper(probe[0]) == 'V') {
+            int node = 0;
+            stringstream ss(target);
+            if (!(ss >> node) || !(ss >> ws).eof() || (node != 0 && !nodeNumbering.contains(node))) {
+                cout << "Error: Probe '" << probe << "' does not name an existing node." << endl;
+                return false;
+            }
+            if (node != 0) addTerm(j, nodeNumbering.indexOf(node), 1.0);
+            continue;
+        }
+        int id = wellFormed ? netlist.find(target) : -1;
+        if (id == -1) {
+            cout << "Error: Probe '" << probe << "' must be V(<node>) or I(<element>) for an existing node or element." << endl;
+            return false;
+        }
+        int pos = netlist.positions[id];
+        switch (netlist.types[id]) {
+            case ComponentType::RESISTOR: {
+                const auto& r = program.resistors[pos];
+                addTerm(j, r.a, run.coefficient(r.slot));
+                addTerm(j, r.b, -run.coefficient(r.slot));
+                break;
+            }
+            case ComponentType::INDUCTOR:
+                addTerm(j, program.inductors[pos].branch, 1.0);
+                break;
+            case ComponentType::VOLTAGE_SOURCE:
+                addTerm(j, program.voltageSources[pos].branch, 1.0);
+                break;
+            case ComponentType::CURRENT_SOURCE: {
+                auto swept = find(sourceIds.begin(), sourceIds.end(), id);
+                if (swept != sourceIds.end()) {
+                    probeSlope(j, swept - sourceIds.begin()) += 1.0;
+                } else {
+                    probeBase(j) += run.source(id).offset;
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    int points = pointCount;
+    result.sourceValues.resize(points, axisCount);
+    result.values.resize(points, probeCount);
+    int grainSize = max(256, points / (8 * pool.size()));
+    pool.parallelFor(points, grainSize, [&](int begin, int end) {
+        for (int p = begin; p < end; ++p) {
+            int rest = p;
+            for (int k = axisCount - 1; k >= 0; --k) {
+                result.sourceValues(p, k) = axes[k].valueAt(rest % counts[k]);
+                rest /= counts[k];
+            }
+            for (int j = 0; j < probeCount; ++j) {
+                double value = probeBase(j);
+                for (int k = 0; k < axisCount; ++k) value += probeSlope(j, k) * result.sourceValues(p, k);
+                result.values(p, j) = value;
+            }
+        }
+    });
+    return true;
 }
 
+void Circuit::simulateMultiSourceSweep(const vector<SweepAxis>& axes, const vector<string>& probes) {
+    SweepResult result;
+    if (!sweepSources(axes, probes, result)) {
+        return;
+    }
+    cout << "\n--- Multi-Source DC Sweep Results (" << result.values.rows() << " points) ---" << endl;
+    for (const auto& name : result.sources) cout << setw(14) << name;
+    for (const auto& name : result.probes) cout << setw(14) << name;
+    cout << endl << scientific << setprecision(4);
+    for (int p = 0; p < result.values.rows(); ++p) {
+        for (int k = 0; k < result.sourceValues.cols(); ++k) cout << setw(14) << result.sourceValues(p, k);
+        for (int j = 0; j < result.values.cols(); ++j) cout << setw(14) << result.values(p, j);
+        cout << endl;
+    }
+    cout << "--- Multi-Source DC Sweep Finished ---" << endl;
+}
 
 bool Circuit::hasGround() const {
-    for (const auto& comp : components) {
-        if (comp->getNode1() == 0 || comp->getNode2() == 0) {
-            return true;
+    return nodeNumbering.hasGround();
+}
+
+bool Circuit::setElementNodes(const string& componentName, int newNode1, int newNode2) {
+    int id = elements->find(componentName);
+    if (id == -1) return false;
+    nodeNumbering.removeReference(elements->node1Of(id));
+    nodeNumbering.removeReference(elements->node2Of(id));
+    nodeNumbering.addReference(newNode1);
+    nodeNumbering.addReference(newNode2);
+    editStructure().setNodes(id, newNode1, newNode2);
+    return true;
+}
+
+// Structural edits drop everything derived from the old structure. A snapshot
+// still held elsewhere keeps the netlist it was built from.
+CompactNetlist& Circuit::editStructure() {
+    invalidateTopology();
+    if (elements.use_count() > 1) elements = make_shared<CompactNetlist>(*elements);
+    return *elements;
+}
+
+// Analyses that may outlive the next edit, or run on other threads, take
+// their own reference to an up-to-date snapshot.
+shared_ptr<const NetlistSnapshot> Circuit::getSnapshot() const {
+    lock_guard<mutex> lock(cacheMutex);
+    return currentSnapshot();
+}
+
+// Callers hold cacheMutex.
+const shared_ptr<const NetlistSnapshot>& Circuit::currentSnapshot() const {
+    if (!snapshot) {
+        auto fresh = make_shared<NetlistSnapshot>();
+        fresh->netlist = elements;
+        fresh->program = StampProgram::compile(*elements, nodeNumbering);
+        snapshot = move(fresh);
+    }
+    return snapshot;
+}
+
+// Callers hold cacheMutex.
+SimulationContext& Circuit::liveContext() {
+    if (!context) {
+        context = make_unique<SimulationContext>(currentSnapshot());
+        context->setIntegrationMethod(transientOptions.method);
+    }
+    return *context;
+}
+
+SimulationContext& Circuit::getContext() {
+    lock_guard<mutex> lock(cacheMutex);
+    return liveContext();
+}
+
+// Analyses run on a copy of the live context, so they start from its
+// factorization with the value edits since then pending as low-rank updates,
+// and only refactor when they need another step size or too many edits have
+// piled up.
+SimulationContext Circuit::seedContext() {
+    lock_guard<mutex> lock(cacheMutex);
+    SimulationContext& live = liveContext();
+    live.prefactor();
+    SimulationContext seed(live);
+    seed.resetSolution();
+    return seed;
+}
+
+void Circuit::setTransientOptions(const TransientOptions& options) {
+    transientOptions = options;
+    if (context) context->setIntegrationMethod(options.method);
+}
+
+// Values are compiled into each snapshot's program, so an edit drops the
+// cached snapshot. The live context is patched instead of rebuilt: sources
+// only appear in the RHS, and a passive value edit keeps the stamp pattern,
+// so it becomes a delta stamp on the live factorization.
+bool Circuit::setElementParameter(const string& componentName, ElementParameter parameter, double value) {
+    int id = elements->find(componentName);
+    if (id == -1) return false;
+    snapshot.reset();
+    if (!elements->setParameter(id, parameter, value)) return false;
+    if (!context) return true;
+    const CompactNetlist& netlist = *elements;
+    int pos = netlist.positions[id];
+    ComponentType type = netlist.types[id];
+    if (parameter == ElementParameter::INITIAL_CONDITION) {
+        context->setInitialCondition(id, value);
+    } else if (type == ComponentType::VOLTAGE_SOURCE || type == ComponentType::CURRENT_SOURCE) {
+        const SourceArrays& sources = type == ComponentType::VOLTAGE_SOURCE ? netlist.voltageSources : netlist.currentSources;
+        context->setSource(id, sources.offset[pos], sources.amplitude[pos], sources.frequency[pos]);
+    } else {
+        context->setElementValue(id, value);
+    }
+    return true;
+}
+
+// Concurrent analyses of one circuit may all ask for the report; the first
+// builds it and the rest wait for it to be complete.
+const TopologyReport& Circuit::validateTopology() {
+    lock_guard<mutex> lock(cacheMutex);
+    if (topologyValid) return topologyReport;
+    TopologyReport report;
+    const CompactNetlist& netlist = getCompactNetlist();
+
+    // Index 0 is ground, node index i + 1 is the circuit's dense node index i.
+    int nodeCount = nodeNumbering.size() + 1;
+    auto indexOf = [this](int node) { return node == 0 ? 0 : nodeNumbering.indexOf(node) + 1; };
+    auto nodeNumber = [this](int idx) { return idx == 0 ? 0 : nodeNumbering.getNodeNumbers()[idx - 1]; };
+
+    // Three nested connectivity levels: all elements, everything but current
+    // sources, and only the elements that carry DC current (R, L, V).
+    DisjointSet anyPath(nodeCount), noCurrentSources(nodeCount), dcPath(nodeCount);
+    for (int id = 0; id < netlist.size(); ++id) {
+        int a = indexOf(netlist.node1Of(id));
+        int b = indexOf(netlist.node2Of(id));
+        anyPath.unite(a, b);
+        if (netlist.types[id] == ComponentType::CURRENT_SOURCE) continue;
+        noCurrentSources.unite(a, b);
+        if (netlist.types[id] == ComponentType::CAPACITOR) continue;
+        dcPath.unite(a, b);
+    }
+
+    map<int, vector<int>> floating, currentCutsets, capacitorCutsets;
+    for (int i = 1; i < nodeCount; ++i) {
+        if (anyPath.find(i) != anyPath.find(0)) {
+            floating[anyPath.find(i)].push_back(nodeNumber(i));
+        } else if (noCurrentSources.find(i) != noCurrentSources.find(0)) {
+            currentCutsets[noCurrentSources.find(i)].push_back(nodeNumber(i));
+        } else if (dcPath.find(i) != dcPath.find(0)) {
+            capacitorCutsets[dcPath.find(i)].push_back(nodeNumber(i));
         }
     }
-    return false;
+    // "node 5" or "nodes 5, 7", so each message agrees with its node count.
+    auto nodeList = [](vector<int> nodes) {
+        sort(nodes.begin(), nodes.end());
+        stringstream ss;
+        ss << (nodes.size() == 1 ? "node " : "nodes ");
+        for (size_t i = 0; i < nodes.size(); ++i) ss << (i ? ", " : "") << nodes[i];
+        return ss.str();
+    };
+    auto capitalized = [](string text) {
+        text[0] = (char)toupper((unsigned char)text[0]);
+        return text;
+    };
+    for (const auto& [root, nodes] : floating) {
+        report.errors.push_back("Floating subnetwork with no connection to ground: " + nodeList(nodes));
+    }
+    for (const auto& [root, nodes] : currentCutsets) {
+        report.errors.push_back(capitalized(nodeList(nodes)) + (nodes.size() == 1 ? " is" : " are") +
+                                " connected to ground only through current sources");
+    }
+    for (const auto& [root, nodes] : capacitorCutsets) {
+        report.warnings.push_back(capitalized(nodeList(nodes)) + (nodes.size() == 1 ? " has" : " have") +
+                                  " no DC path to ground (only capacitors and current sources)");
+    }
+
+    // Voltage sources are added to the spanning forest before inductors, so a
+    // closing voltage source means a pure source loop and a closing inductor
+    // means a loop that is only a problem at DC. The loop members are
+    // recovered with a DFS over the forest built so far.
+    DisjointSet loops(nodeCount);
+    vector<vector<pair<int, int>>> forest(nodeCount);
+    auto findLoop = [&](int from, int to, int closing) {
+        vector<int> parentEdge(nodeCount, -1), parentNode(nodeCount, -1);
+        vector<bool> visited(nodeCount, false);
+        vector<int> stack = {from};
+        visited[from] = true;
+        while (!stack.empty()) {
+            int node = stack.back();
+            stack.pop_back();
+            if (node == to) break;
+            for (const auto& [next, edge] : forest[node]) {
+                if (visited[next]) continue;
+                visited[next] = true;
+                parentNode[next] = node;
+                parentEdge[next] = edge;
+                stack.push_back(next);
+            }
+        }
+        string members(netlist.names.name(closing));
+        for (int node = to; node != from && parentEdge[node] != -1; node = parentNode[node]) {
+            members += ", " + string(netlist.names.name(parentEdge[node]));
+        }
+        return members;
+    };
+    for (int pass = 0; pass < 2; ++pass) {
+        for (int id = 0; id < netlist.size(); ++id) {
+            bool isSource = netlist.types[id] == ComponentType::VOLTAGE_SOURCE;
+            bool isInductor = netlist.types[id] == ComponentType::INDUCTOR;
+            if ((pass == 0 && !isSource) || (pass == 1 && !isInductor)) continue;
+            int a = indexOf(netlist.node1Of(id));
+            int b = indexOf(netlist.node2Of(id));
+            if (loops.unite(a, b)) {
+                forest[a].push_back({b, id});
+                forest[b].push_back({a, id});
+            } else if (isSource) {
+                report.errors.push_back("Loop of voltage sources: " + findLoop(a, b, id));
+            } else {
+                report.warnings.push_back("Loop of voltage sources and inductors (shorted at DC): " + findLoop(a, b, id));
+            }
+        }
+    }
+    topologyReport = move(report);
+    topologyValid = true;
+    return topologyReport;
+}
+
+bool Circuit::checkTopology(ostream& out) {
+    const TopologyReport& report = validateTopology();
+    for (const auto& warning : report.warnings) {
+        out << "Warning: " << warning << "." << endl;
+    }
+    for (const auto& error : report.errors) {
+        out << "Error: " << error << "." << endl;
+    }
+    return report.isValid();
 }
 
 bool Circuit::renameNode(int oldNodeNum, int newNodeNum) {
-    auto allNodes = getAllNodes();
-    if (allNodes.find(oldNodeNum) == allNodes.end()) {
+    if (!nodeNumbering.contains(oldNodeNum)) {
         cout << "Error: Node " << oldNodeNum << " does not exist in the circuit." << endl;
         return false;
     }
-    if (oldNodeNum != newNodeNum && allNodes.count(newNodeNum) > 0) {
+    if (oldNodeNum != newNodeNum && nodeNumbering.contains(newNodeNum)) {
         cout << "Error: Node " << newNodeNum << " already exists. Merging nodes is not supported directly." << endl;
         return false;
     }
-    for (auto& comp : components) {
-        int n1 = comp->getNode1();
-        int n2 = comp->getNode2();
-        bool changed = false;
-        if (n1 == oldNodeNum) {
-            n1 = newNodeNum;
-            changed = true;
-        }
-        if (n2 == oldNodeNum) {
-            n2 = newNodeNum;
-            changed = true;
-        }
-        if (changed) {
-            comp->setNodes(n1, n2);
-        }
-    }
+    editStructure().renameNode(oldNodeNum, newNodeNum);
+    nodeNumbering.rename(oldNodeNum, newNodeNum);
     cout << "Success: Node " << oldNodeNum << " renamed to " << newNodeNum << " throughout the circuit." << endl;
     return true;
 }
 
 void Circuit::displayNodes() const {
-    if (components.empty()) {
+    if (elements->size() == 0) {
         cout << "Circuit is empty, no nodes to display." << endl;
         return;
     }
-    auto unique_nodes = getAllNodes();
+    vector<int> unique_nodes = nodeNumbering.getNodeNumbers();
+    if (nodeNumbering.hasGround()) unique_nodes.push_back(0);
+    sort(unique_nodes.begin(), unique_nodes.end());
     cout << "--- Existing Nodes in Circuit '" << circuitName << "' ---" << endl;
     if (unique_nodes.empty()) {
         cout << "No nodes found." << endl;
@@ -1107,22 +3871,17 @@ void Circuit::displayNodes() const {
 }
 
 bool Circuit::removeElement(const string& componentName) {
-    for (auto it = components.begin(); it != components.end(); ++it) {
-        if ((*it)->getName() == componentName) {
-            components.erase(it);
-            return true;
-        }
-    }
-    return false;
+    int id = elements->find(componentName);
+    if (id == -1) return false;
+    nodeNumbering.removeReference(elements->node1Of(id));
+    nodeNumbering.removeReference(elements->node2Of(id));
+    editStructure().remove(id);
+    return true;
 }
 
-Component* Circuit::findElement(const string& componentName) {
-    for (const auto& comp : components) {
-        if (comp->getName() == componentName) {
-            return comp.get();
-        }
-    }
-    return nullptr;
+unique_ptr<Component> Circuit::findElement(const string& componentName) const {
+    int id = elements->find(componentName);
+    return id == -1 ? nullptr : elements->element(id);
 }
 
 
@@ -1152,6 +3911,111 @@ void handleTransientAnalysis(Circuit& circuit) {
     circuit.runTransientAnalysis(startTime, endTime, timeStep);
 }
 
+void handleTransientSettings(Circuit& circuit) {
+    cout << "\n--- Transient Settings for " << circuit.getCircuitName() << " ---" << endl;
+    TransientOptions options = circuit.getTransientOptions();
+    cout << "Integration method: " << integrationMethodName(options.method) << endl;
+    int method = 0;
+    while (true) {
+        if (!safelyReadInt(method, "Enter integration method, 1 = Backward Euler, 2 = Trapezoidal, 3 = Gear (or 'b' to go back to main menu): ")) return;
+        if (method >= 1 && method <= 3) break;
+        cout << "Invalid choice. Please try again." << endl;
+    }
+    const IntegrationMethod methods[] = {IntegrationMethod::BACKWARD_EULER, IntegrationMethod::TRAPEZOIDAL, IntegrationMethod::GEAR};
+    options.method = methods[method - 1];
+
+    cout << "Adaptive time steps: " << (options.adaptive ? "on" : "off") << endl;
+    string answer;
+    while (true) {
+        if (!safelyReadString(answer, "Use adaptive time steps? (y/n) (or 'b' to go back to main menu): ")) return;
+        if (answer == "y" || answer == "Y" || answer == "n" || answer == "N") break;
+        cout << "Invalid choice. Please try again." << endl;
+    }
+    options.adaptive = answer == "y" || answer == "Y";
+    if (options.adaptive) {
+        cout << "Current: reltol " << options.relativeTolerance << ", abstol " << options.absoluteTolerance
+             << ", growth limit " << options.stepGrowthLimit << ", shrink limit " << options.stepShrinkLimit
+             << ", max step " << options.maxStep << endl;
+        while (true) {
+            if (!safelyReadDouble(options.relativeTolerance, "Enter relative tolerance (or 'b' to go back to main menu): ")) return;
+            if (!safelyReadDouble(options.absoluteTolerance, "Enter absolute tolerance (or 'b' to go back to main menu): ")) return;
+            if (options.relativeTolerance >= 0 && options.absoluteTolerance >= 0 &&
+                options.relativeTolerance + options.absoluteTolerance > 0) break;
+            cout << "Error: Tolerances must not be negative and cannot both be zero." << endl;
+        }
+        while (true) {
+            if (!safelyReadDouble(options.stepGrowthLimit, "Enter step growth limit, above 1 (or 'b' to go back to main menu): ")) return;
+            if (options.stepGrowthLimit > 1) break;
+            cout << "Error: Growth limit must be greater than 1." << endl;
+        }
+        while (true) {
+            if (!safelyReadDouble(options.stepShrinkLimit, "Enter step shrink limit, between 0 and 1 (or 'b' to go back to main menu): ")) return;
+            if (options.stepShrinkLimit > 0 && options.stepShrinkLimit < 1) break;
+            cout << "Error: Shrink limit must be between 0 and 1." << endl;
+        }
+        while (true) {
+            if (!safelyReadDouble(options.maxStep, "Enter maximum step, 0 for a fiftieth of the run (or 'b' to go back to main menu): ")) return;
+            if (options.maxStep >= 0) break;
+            cout << "Error: Maximum step cannot be negative." << endl;
+        }
+    }
+
+    cout << "Start from DC operating point: " << (options.startFromOperatingPoint ? "on" : "off") << endl;
+    while (true) {
+        if (!safelyReadString(answer, "Start from the DC operating point and initial conditions? (y/n) (or 'b' to go back to main menu): ")) return;
+        if (answer == "y" || answer == "Y" || answer == "n" || answer == "N") break;
+        cout << "Invalid choice. Please try again." << endl;
+    }
+    options.startFromOperatingPoint = answer == "y" || answer == "Y";
+    circuit.setTransientOptions(options);
+    cout << "Transient settings updated." << endl;
+    pauseSystem();
+}
+
+void handleTransientAnalysisOnAll(CircuitManager& manager) {
+    cout << "\n--- Transient Analysis on All Circuits ---" << endl;
+    double startTime, endTime, timeStep;
+    if (!safelyReadDouble(startTime, "Enter start time (s) (or 'b' to go back to main menu): ")) return;
+    if (!safelyReadDouble(endTime, "Enter end time (s) (or 'b' to go back to main menu): ")) return;
+    if (!safelyReadDouble(timeStep, "Enter time step (s) (or 'b' to go back to main menu): ")) return;
+    manager.runTransientOnAll(startTime, endTime, timeStep);
+    pauseSystem();
+}
+
+void handleParameterSweep(Circuit& circuit) {
+    cout << "\n--- Component Value Sweep for " << circuit.getCircuitName() << " ---" << endl;
+    string componentName;
+    double startValue, endValue, stepValue, timeStep;
+    if (!safelyReadString(componentName, "Enter the name of the R, C or L to sweep (or 'b' to go back to main menu): ")) return;
+    if (!safelyReadDouble(startValue, "Enter start value (or 'b' to go back to main menu): ")) return;
+    if (!safelyReadDouble(endValue, "Enter end value (or 'b' to go back to main menu): ")) return;
+    if (!safelyReadDouble(stepValue, "Enter value step (or 'b' to go back to main menu): ")) return;
+    if (!safelyReadDouble(timeStep, "Enter transient time step, 0 for DC (R only) (or 'b' to go back to main menu): ")) return;
+    double endTime = 0.0;
+    if (timeStep > 0 && !safelyReadDouble(endTime, "Enter transient end time (or 'b' to go back to main menu): ")) return;
+    circuit.simulateParameterSweep(componentName, startValue, endValue, stepValue, timeStep, endTime);
+    pauseSystem();
+}
+
+void handleMultiSourceSweep(Circuit& circuit) {
+    cout << "\n--- Multi-Source DC Sweep for " << circuit.getCircuitName() << " ---" << endl;
+    int sourceCount = 0;
+    if (!safelyReadInt(sourceCount, "Enter the number of sources to sweep (or 'b' to go back to main menu): ")) return;
+    vector<SweepAxis> axes(max(0, sourceCount));
+    for (auto& axis : axes) {
+        if (!safelyReadString(axis.source, "Enter source name (or 'b' to go back to main menu): ")) return;
+        if (!safelyReadDouble(axis.start, "Enter start value (or 'b' to go back to main menu): ")) return;
+        if (!safelyReadDouble(axis.end, "Enter end value (or 'b' to go back to main menu): ")) return;
+        if (!safelyReadDouble(axis.step, "Enter value step (or 'b' to go back to main menu): ")) return;
+    }
+    string line;
+    vector<string> probes;
+    cout << "Enter probes such as V(2) I(R1), blank for all node voltages (or 'b' to go back to main menu): ";
+    if (!safelyReadComponentParameters(line, probes)) return;
+    circuit.simulateMultiSourceSweep(axes, probes);
+    pauseSystem();
+}
+
 void handleMultipleVariablesAnalysis(Circuit& circuit) {
     bool sub_menu_running = true;
     while (sub_menu_running) {
@@ -1357,7 +4221,7 @@ void handleModifyComponent(Circuit& circuit) {
     getline(cin, name_to_modify);
     if (name_to_modify == "b" || name_to_modify == "B") return;
 
-    Component* comp = circuit.findElement(name_to_modify);
+    unique_ptr<Component> comp = circuit.findElement(name_to_modify);
     if (!comp) {
         handleErrorComponentNotFound(name_to_modify);
         pauseSystem();
@@ -1372,17 +4236,19 @@ void handleModifyComponent(Circuit& circuit) {
         cout << "2. Resistance" << endl;
     } else if (comp->getType() == "Capacitor") {
         cout << "2. Capacitance" << endl;
+        cout << "3. Initial Voltage" << endl;
     } else if (comp->getType() == "Inductor") {
         cout << "2. Inductance" << endl;
+        cout << "3. Initial Current" << endl;
     } else if (comp->getType() == "Voltage Source") {
         cout << "2. DC Value/Offset" << endl;
-        if (dynamic_cast<VoltageSource*>(comp)->getWaveformType() == VoltageSource::Waveform::SINE) {
+        if (dynamic_cast<VoltageSource*>(comp.get())->getWaveformType() == VoltageSource::Waveform::SINE) {
             cout << "3. Amplitude" << endl;
             cout << "4. Frequency" << endl;
         }
     } else if (comp->getType() == "Current Source") {
         cout << "2. DC Value/Offset" << endl;
-        if (dynamic_cast<CurrentSource*>(comp)->getWaveformType() == CurrentSource::Waveform::SINE) {
+        if (dynamic_cast<CurrentSource*>(comp.get())->getWaveformType() == CurrentSource::Waveform::SINE) {
             cout << "3. Amplitude" << endl;
             cout << "4. Frequency" << endl;
         }
@@ -1410,16 +4276,16 @@ void handleModifyComponent(Circuit& circuit) {
             pauseSystem();
             return;
         }
-        comp->setNodes(n1, n2);
+        circuit.setElementNodes(comp->getName(), n1, n2);
         cout << "Nodes successfully updated." << endl;
     } else if (modify_choice == 2) {
-        if (auto res = dynamic_cast<Resistor*>(comp)) {
+        if (auto res = dynamic_cast<Resistor*>(comp.get())) {
             double new_res;
             cout << "Enter new resistance: ";
             safelyReadDouble(new_res);
-            res->setResistance(new_res);
+            circuit.setElementParameter(res->getName(), ElementParameter::VALUE, new_res);
             cout << "Resistance successfully updated." << endl;
-        } else if (auto cap = dynamic_cast<Capacitor*>(comp)) {
+        } else if (auto cap = dynamic_cast<Capacitor*>(comp.get())) {
             double new_cap;
             string cap_str;
             cout << "Enter new capacitance (e.g., 100n for 100 nanofarads, 10u for 10 microfarads): ";
@@ -1431,9 +4297,9 @@ void handleModifyComponent(Circuit& circuit) {
                 pauseSystem();
                 return;
             }
-            cap->setCapacitance(new_cap);
+            circuit.setElementParameter(cap->getName(), ElementParameter::VALUE, new_cap);
             cout << "Capacitance successfully updated." << endl;
-        } else if (auto ind = dynamic_cast<Inductor*>(comp)) {
+        } else if (auto ind = dynamic_cast<Inductor*>(comp.get())) {
             double new_ind;
             string ind_str;
             cout << "Enter new inductance (e.g., 10m for 10 millihenries, 1u for 1 microhenry): ";
@@ -1445,40 +4311,56 @@ void handleModifyComponent(Circuit& circuit) {
                 pauseSystem();
                 return;
             }
-            ind->setInductance(new_ind);
+            circuit.setElementParameter(ind->getName(), ElementParameter::VALUE, new_ind);
             cout << "Inductance successfully updated." << endl;
-        } else if (auto vs = dynamic_cast<VoltageSource*>(comp)) {
+        } else if (auto vs = dynamic_cast<VoltageSource*>(comp.get())) {
             double new_val;
             cout << "Enter new DC value/offset: ";
             safelyReadDouble(new_val);
-            vs->setDCOffsetValue(new_val);
+            circuit.setElementParameter(vs->getName(), ElementParameter::VALUE, new_val);
             cout << "DC value/offset successfully updated." << endl;
-        } else if (auto cs = dynamic_cast<CurrentSource*>(comp)) {
+        } else if (auto cs = dynamic_cast<CurrentSource*>(comp.get())) {
             double new_val;
             cout << "Enter new DC value/offset: ";
             safelyReadDouble(new_val);
-            cs->setDCOffsetValue(new_val);
+            circuit.setElementParameter(cs->getName(), ElementParameter::VALUE, new_val);
             cout << "DC value/offset successfully updated." << endl;
         } else {
             cout << "Invalid modification choice for this component type." << endl;
         }
+    } else if (modify_choice == 3 && (dynamic_cast<Capacitor*>(comp.get()) || dynamic_cast<Inductor*>(comp.get()))) {
+        bool capacitor = dynamic_cast<Capacitor*>(comp.get()) != nullptr;
+        string ic_str;
+        cout << "Enter initial " << (capacitor ? "voltage" : "current") << " for a run from the operating point ('n' for none): ";
+        getline(cin, ic_str);
+        if (ic_str == "b" || ic_str == "B") return;
+        double initialValue = numeric_limits<double>::quiet_NaN();
+        if (ic_str != "n" && ic_str != "N") {
+            try { initialValue = stod(ic_str); } catch (...) {
+                cout << "Invalid value. Please try again." << endl;
+                pauseSystem();
+                return;
+            }
+        }
+        circuit.setElementParameter(comp->getName(), ElementParameter::INITIAL_CONDITION, initialValue);
+        cout << "Initial condition successfully updated." << endl;
     } else if (modify_choice == 3) {
-        if (auto vs = dynamic_cast<VoltageSource*>(comp)) {
+        if (auto vs = dynamic_cast<VoltageSource*>(comp.get())) {
             if (vs->getWaveformType() == VoltageSource::Waveform::SINE) {
                 double new_amp;
                 cout << "Enter new amplitude: ";
                 safelyReadDouble(new_amp);
-                vs->setAmplitude(new_amp);
+                circuit.setElementParameter(vs->getName(), ElementParameter::AMPLITUDE, new_amp);
                 cout << "Amplitude successfully updated." << endl;
             } else {
                 cout << "Invalid modification choice for this component type." << endl;
             }
-        } else if (auto cs = dynamic_cast<CurrentSource*>(comp)) {
+        } else if (auto cs = dynamic_cast<CurrentSource*>(comp.get())) {
             if (cs->getWaveformType() == CurrentSource::Waveform::SINE) {
                 double new_amp;
                 cout << "Enter new amplitude: ";
                 safelyReadDouble(new_amp);
-                cs->setAmplitude(new_amp);
+                circuit.setElementParameter(cs->getName(), ElementParameter::AMPLITUDE, new_amp);
                 cout << "Amplitude successfully updated." << endl;
             } else {
                 cout << "Invalid modification choice for this component type." << endl;
@@ -1487,22 +4369,22 @@ void handleModifyComponent(Circuit& circuit) {
             cout << "Invalid modification choice for this component type." << endl;
         }
     } else if (modify_choice == 4) {
-        if (auto vs = dynamic_cast<VoltageSource*>(comp)) {
+        if (auto vs = dynamic_cast<VoltageSource*>(comp.get())) {
             if (vs->getWaveformType() == VoltageSource::Waveform::SINE) {
                 double new_freq;
                 cout << "Enter new frequency: ";
                 safelyReadDouble(new_freq);
-                vs->setFrequency(new_freq);
+                circuit.setElementParameter(vs->getName(), ElementParameter::FREQUENCY, new_freq);
                 cout << "Frequency successfully updated." << endl;
             } else {
                 cout << "Invalid modification choice for this component type." << endl;
             }
-        } else if (auto cs = dynamic_cast<CurrentSource*>(comp)) {
+        } else if (auto cs = dynamic_cast<CurrentSource*>(comp.get())) {
             if (cs->getWaveformType() == CurrentSource::Waveform::SINE) {
                 double new_freq;
                 cout << "Enter new frequency: ";
                 safelyReadDouble(new_freq);
-                cs->setFrequency(new_freq);
+                circuit.setElementParameter(cs->getName(), ElementParameter::FREQUENCY, new_freq);
                 cout << "Frequency successfully updated." << endl;
             } else {
                 cout << "Invalid modification choice for this component type." << endl;
@@ -1532,8 +4414,8 @@ void Circuit::saveCircuit(const string& filename) const {
     }
 
     outFile << "CIRCUIT_NAME " << circuitName << endl;
-    for (const auto& comp : components) {
-        outFile << comp->serialize() << endl;
+    for (int id = 0; id < elements->size(); ++id) {
+        outFile << elements->element(id)->serialize() << endl;
     }
 
     outFile.close();
@@ -1547,7 +4429,9 @@ bool Circuit::loadCircuit(const string& filename) {
         return false;
     }
 
-    components.clear();
+    elements = make_shared<CompactNetlist>();
+    nodeNumbering.clear();
+    invalidateTopology();
     string line;
     string loadedCircuitName = "Unnamed Circuit";
     if (getline(inFile, line)) {
@@ -1564,6 +4448,15 @@ bool Circuit::loadCircuit(const string& filename) {
     }
     setCircuitName(loadedCircuitName);
 
+    // Capacitors and inductors may end with an optional IC=<value> token.
+    auto readInitialCondition = [](stringstream& ss, double& value) {
+        value = numeric_limits<double>::quiet_NaN();
+        string token;
+        if (!(ss >> token)) return true;
+        if (token.rfind("IC=", 0) != 0) return false;
+        try { value = stod(token.substr(3)); } catch (...) { return false; }
+        return true;
+    };
 
     while (getline(inFile, line)) {
         stringstream ss(line);
@@ -1585,19 +4478,23 @@ bool Circuit::loadCircuit(const string& filename) {
             }
             addElement(make_unique<Resistor>(name, resistance, n1, n2));
         } else if (type_str == "Capacitor") {
-            double capacitance;
-            if (!(ss >> capacitance >> n1 >> n2)) {
+            double capacitance, initialVoltage;
+            if (!(ss >> capacitance >> n1 >> n2) || !readInitialCondition(ss, initialVoltage)) {
                 cout << "Error loading Capacitor: Invalid format for '" << name << "'." << endl;
                 continue;
             }
-            addElement(make_unique<Capacitor>(name, capacitance, n1, n2));
+            auto capacitor = make_unique<Capacitor>(name, capacitance, n1, n2);
+            capacitor->setInitialCondition(initialVoltage);
+            addElement(move(capacitor));
         } else if (type_str == "Inductor") {
-            double inductance;
-            if (!(ss >> inductance >> n1 >> n2)) {
+            double inductance, initialCurrent;
+            if (!(ss >> inductance >> n1 >> n2) || !readInitialCondition(ss, initialCurrent)) {
                 cout << "Error loading Inductor: Invalid format for '" << name << "'." << endl;
                 continue;
             }
-            addElement(make_unique<Inductor>(name, inductance, n1, n2));
+            auto inductor = make_unique<Inductor>(name, inductance, n1, n2);
+            inductor->setInitialCondition(initialCurrent);
+            addElement(move(inductor));
         } else if (type_str == "VoltageSource") {
             string waveform_type_str;
             double offset_or_dc_value, amplitude, frequency;
@@ -1720,6 +4617,27 @@ void CircuitManager::selectCircuit() {
     }
 }
 
+// Each circuit runs as its own pool task with a private result and log; the
+// reports are printed afterwards in circuit order.
+void CircuitManager::runTransientOnAll(double startTime, double endTime, double timeStep, ThreadPool& pool) {
+    if (circuits.empty()) {
+        cout << "No circuits available." << endl;
+        return;
+    }
+    vector<LoggedTransientResult> results(circuits.size());
+    pool.parallelFor(circuits.size(), 1, [&](int begin, int end) {
+        for (int i = begin; i < end; ++i) {
+            circuits[i]->computeTransient(startTime, endTime, timeStep, results[i], results[i].log);
+        }
+    });
+
+    TransientPrinter printer(cout);
+    for (size_t i = 0; i < circuits.size(); ++i) {
+        cout << "\n=== Circuit: " << circuits[i]->getCircuitName() << " ===" << endl;
+        results[i].replay(printer, cout);
+    }
+}
+
 void CircuitManager::removeActiveCircuit() {
     if (activeCircuitIndex != -1) {
         cout << "Are you sure you want to delete circuit '" << circuits[activeCircuitIndex]->getCircuitName() << "'? (y/n): ";
@@ -0,0 +1,656 @@
+// Engine-level checks, built from main.cpp without its menu loop. Each test
+// is registered by name and run on its own, as in
+// `engine_tests sparse_ladder_matches_dense`; CMakeLists.txt adds one ctest
+// entry per name. Expected values come from closed forms or from references
+// built here independently of the engine.
+#define CIRCUIT_NO_MAIN
+#include "../main.cpp"
+
+namespace {
+
+map<string, void (*)()>& registry() {
+    static map<string, void (*)()> tests;
+    return tests;
+}
+
+struct Registration {
+    Registration(const char* name, void (*test)()) { registry()[name] = test; }
+};
+
+int failures = 0;
+
+#define TEST_CASE(name)                                  \
+    void name();                                         \
+    Registration name##_registration(#name, name);       \
+    void name()
+
+#define CHECK(condition)                                                                        \
+    do {                                                                                        \
+        if (!(condition)) {                                                                     \
+            cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #condition ") failed" << endl; \
+            ++failures;                                                                         \
+        }                                                                                       \
+    } while (0)
+
+#define CHECK_CLOSE(actual, expected, relative)                                                      \
+    do {                                                                                             \
+        double a_ = (actual), e_ = (expected);                                                       \
+        if (!(abs(a_ - e_) <= (relative) * max(abs(e_), 1e-300))) {                                  \
+            cerr << __FILE__ << ":" << __LINE__ << ": " #actual " = " << setprecision(17) << a_      \
+                 << ", expected " << e_ << endl;                                                     \
+            ++failures;                                                                              \
+        }                                                                                            \
+    } while (0)
+
+double nodeVoltage(const SimulationContext& run, int node) {
+    const vector<int>& numbers = run.getProgram().nodeNumbers;
+    auto it = find(numbers.begin(), numbers.end(), node);
+    return it == numbers.end() ? 0.0 : run.solution(it - numbers.begin());
+}
+
+// 1 mA into node 1 of a ladder: RS<k> = 100 Ohm from node k to k + 1 and
+// RG<k> = 1 kOhm from node k + 1 to ground, plus RG0 from node 1 to ground.
+void buildLadder(Circuit& circuit, int sections) {
+    circuit.addElement(make_unique<CurrentSource>("I1", 1e-3, 0, 1));
+    circuit.addElement(make_unique<Resistor>("RG0", 1000, 1, 0));
+    for (int k = 1; k <= sections; ++k) {
+        circuit.addElement(make_unique<Resistor>("RS" + to_string(k), 100, k, k + 1));
+        circuit.addElement(make_unique<Resistor>("RG" + to_string(k), 1000, k + 1, 0));
+    }
+}
+
+// Node voltages of buildLadder from a dense nodal solve.
+Eigen::VectorXd ladderReference(int sections) {
+    int n = sections + 1;
+    Eigen::MatrixXd g = Eigen::MatrixXd::Zero(n, n);
+    Eigen::VectorXd i = Eigen::VectorXd::Zero(n);
+    for (int k = 0; k < n; ++k) g(k, k) += 1e-3;
+    for (int k = 0; k + 1 < n; ++k) {
+        g(k, k) += 1e-2;
+        g(k + 1, k + 1) += 1e-2;
+        g(k, k + 1) -= 1e-2;
+        g(k + 1, k) -= 1e-2;
+    }
+    i(0) = 1e-3;
+    return g.partialPivLu().solve(i);
+}
+
+// Keeps every row of a transient run.
+class RecordingSink : public TransientSink {
+public:
+    vector<string> labels;
+    vector<double> times;
+    vector<Eigen::VectorXd> rows;
+    bool ended = false;
+
+    void begin(const vector<string>& columnLabels) override { labels = columnLabels; }
+    void row(double time, const Eigen::VectorXd& values) override {
+        times.push_back(time);
+        rows.push_back(values);
+    }
+    void end() override { ended = true; }
+
+    int column(const string& label) const { return find(labels.begin(), labels.end(), label) - labels.begin(); }
+};
+
+// Backward Euler on buildLadder with C = 1 uF from every node to ground,
+// from rest: (G + C / h) v[n + 1] = C / h v[n] + i.
+vector<Eigen::VectorXd> ladderBackwardEuler(int sections, double timeStep, int steps) {
+    int n = sections + 1;
+    Eigen::MatrixXd g = Eigen::MatrixXd::Zero(n, n);
+    for (int k = 0; k < n; ++k) g(k, k) += 1e-3 + 1e-6 / timeStep;
+    for (int k = 0; k + 1 < n; ++k) {
+        g(k, k) += 1e-2;
+        g(k + 1, k + 1) += 1e-2;
+        g(k, k + 1) -= 1e-2;
+        g(k + 1, k) -= 1e-2;
+    }
+    Eigen::PartialPivLU<Eigen::MatrixXd> lu(g);
+    vector<Eigen::VectorXd> states;
+    Eigen::VectorXd v = Eigen::VectorXd::Zero(n);
+    for (int step = 0; step < steps; ++step) {
+        Eigen::VectorXd rhs = 1e-6 / timeStep * v;
+        rhs(0) += 1e-3;
+        v = lu.solve(rhs);
+        states.push_back(v);
+    }
+    return states;
+}
+
+}  // namespace
+
+// Below SPARSE_MNA_THRESHOLD unknowns the dense LU solves, above it SparseLU;
+// both must agree with an independent dense nodal solve at every node.
+TEST_CASE(sparse_ladder_matches_dense) {
+    for (int sections : {SPARSE_MNA_THRESHOLD / 4, 2 * SPARSE_MNA_THRESHOLD}) {
+        Circuit circuit;
+        buildLadder(circuit, sections);
+        SimulationContext run(circuit.getSnapshot());
+        CHECK(run.size() == sections + 1);
+        CHECK(run.solveStep(0, 0));
+        Eigen::VectorXd reference = ladderReference(sections);
+        for (int node = 1; node <= sections + 1; ++node) {
+            CHECK_CLOSE(nodeVoltage(run, node), reference(node - 1), 1e-10);
+        }
+        // All of the source current reaches ground through the shunts.
+        double shunts = 0.0;
+        for (int node = 1; node <= sections + 1; ++node) shunts += nodeVoltage(run, node) / 1000;
+        CHECK_CLOSE(shunts, 1e-3, 1e-10);
+    }
+}
+
+// A sparse RC ladder keeps one symbolic analysis for the whole run and only
+// refactors numerically: every fixed step, and a later change of step size in
+// the same context, must match backward Euler done with a dense LU.
+TEST_CASE(sparse_transient_reuses_pattern) {
+    int sections = 2 * SPARSE_MNA_THRESHOLD;
+    Circuit circuit;
+    buildLadder(circuit, sections);
+    for (int node = 1; node <= sections + 1; ++node) {
+        circuit.addElement(make_unique<Capacitor>("C" + to_string(node), 1e-6, node, 0));
+    }
+    RecordingSink sink;
+    ostringstream log;
+    CHECK(circuit.computeTransient(0, 9e-5, 1e-5, sink, log));
+    CHECK(sink.ended);
+    CHECK(sink.rows.size() == 10);
+    vector<Eigen::VectorXd> reference = ladderBackwardEuler(sections, 1e-5, 10);
+    for (size_t row = 0; row < sink.rows.size(); row += 3) {
+        for (int node : {1, 2, sections / 2, sections + 1}) {
+            CHECK_CLOSE(sink.rows[row](sink.column("V(node " + to_string(node) + ")")), reference[row](node - 1), 1e-9);
+        }
+    }
+
+    SimulationContext run(circuit.getSnapshot());
+    for (int step = 0; step < 3; ++step) CHECK(run.solveStep(step * 2e-5, 2e-5));
+    int n = sections + 1;
+    vector<Eigen::VectorXd> longSteps = ladderBackwardEuler(sections, 2e-5, 3);
+    for (int node : {1, n}) CHECK_CLOSE(nodeVoltage(run, node), longSteps[2](node - 1), 1e-9);
+    CHECK(run.solveStep(6e-5, 5e-6));
+    // One 5 us step from the 2e-5 run's state, done by hand.
+    Eigen::MatrixXd g = Eigen::MatrixXd::Zero(n, n);
+    for (int k = 0; k < n; ++k) g(k, k) += 1e-3 + 1e-6 / 5e-6;
+    for (int k = 0; k + 1 < n; ++k) {
+        g(k, k) += 1e-2;
+        g(k + 1, k + 1) += 1e-2;
+        g(k, k + 1) -= 1e-2;
+        g(k + 1, k) -= 1e-2;
+    }
+    Eigen::VectorXd rhs = 1e-6 / 5e-6 * longSteps[2];
+    rhs(0) += 1e-3;
+    Eigen::VectorXd shortStep = g.partialPivLu().solve(rhs);
+    for (int node : {1, 2, n}) CHECK_CLOSE(nodeVoltage(run, node), shortStep(node - 1), 1e-9);
+}
+
+// V1 = 10 V at node 1, R1 = 1k from 1 to 2, L1 = 1 mH from 2 to 3, R2 = 1k and
+// C1 = 1 uF from 3 to ground, I1 = 1 mA into node 3. The program lists every
+// matrix entry once per stamp with its value slot, and at DC (L shorted, C
+// open) node 3 sits at (10 V + 1 mA * 1k) / 2 = 5.5 V.
+TEST_CASE(stamp_program_compiles_netlist) {
+    Circuit circuit;
+    circuit.addElement(make_unique<VoltageSource>("V1", 10, 1, 0));
+    circuit.addElement(make_unique<Resistor>("R1", 1000, 1, 2));
+    circuit.addElement(make_unique<Inductor>("L1", 1e-3, 2, 3));
+    circuit.addElement(make_unique<Resistor>("R2", 1000, 3, 0));
+    circuit.addElement(make_unique<Capacitor>("C1", 1e-6, 3, 0));
+    circuit.addElement(make_unique<CurrentSource>("I1", 1e-3, 0, 3));
+    shared_ptr<const NetlistSnapshot> snapshot = circuit.getSnapshot();
+    const StampProgram& program = snapshot->program;
+    CHECK(program.nodeCount == 3);
+    CHECK(program.inductorCount == 1);
+    CHECK(program.voltageSourceCount == 1);
+    CHECK(program.size() == 5);
+    CHECK(program.resistors.size() == 2 && program.capacitors.size() == 1);
+    CHECK(program.sourceStamps.size() == 2);
+    // R1: 4 entries, R2 and C1: 1 each, L1: 4 incidence + 1 branch, V1: 2.
+    CHECK(program.matrixStamps.size() == 13);
+    CHECK((program.elementValues == vector<double>{1.0, 1000, 1000, 1e-6, 1e-3}));
+    CHECK_CLOSE(program.coefficientFor(1, 1000, 0), 1e-3, 1e-15);
+    CHECK_CLOSE(program.coefficientFor(3, 1e-6, 1e-5), 0.1, 1e-15);
+    CHECK_CLOSE(program.coefficientFor(4, 1e-3, 1e-5), -100, 1e-15);
+    CHECK(program.coefficientFor(4, 1e-3, 0) == 0.0);
+
+    SimulationContext run(snapshot);
+    CHECK(run.solveStep(0, 0));
+    CHECK_CLOSE(nodeVoltage(run, 1), 10, 1e-12);
+    CHECK_CLOSE(nodeVoltage(run, 2), 5.5, 1e-9);
+    CHECK_CLOSE(nodeVoltage(run, 3), 5.5, 1e-9);
+    const NameTable& names = snapshot->netlist->names;
+    CHECK_CLOSE(run.componentCurrent(names.find("L1")), 4.5e-3, 1e-9);
+    CHECK_CLOSE(run.componentCurrent(names.find("R2")), 5.5e-3, 1e-9);
+    CHECK_CLOSE(run.componentCurrent(names.find("V1")), -4.5e-3, 1e-9);
+}
+
+// Names are interned to dense ids; removing one moves every later id down by
+// one, and name and id lookups must keep pointing at the same element.
+TEST_CASE(names_intern_to_dense_ids) {
+    NameTable table;
+    for (int k = 0; k < 40; ++k) CHECK(table.add("N" + to_string(k)) == k);
+    CHECK(table.size() == 40);
+    for (int k : {0, 7, 16, 39}) CHECK(table.find("N" + to_string(k)) == k);
+    CHECK(table.find("N40") == -1);
+    table.remove(5);
+    CHECK(table.size() == 39);
+    CHECK(table.find("N5") == -1);
+    CHECK(table.find("N4") == 4);
+    CHECK(table.find("N6") == 5);
+    CHECK(table.find("N39") == 38);
+    CHECK(table.name(5) == "N6");
+
+    // V1 = 10 V across R1 = 1k in series with R2 = 2k || R3 = 4k.
+    Circuit circuit;
+    circuit.addElement(make_unique<VoltageSource>("V1", 10, 1, 0));
+    circuit.addElement(make_unique<Resistor>("R1", 1000, 1, 2));
+    circuit.addElement(make_unique<Resistor>("R2", 2000, 2, 0));
+    circuit.addElement(make_unique<Resistor>("R3", 4000, 2, 0));
+    CHECK(circuit.setupAndSolveMNA(0, 0));
+    double v2 = 10 * (4000.0 / 3) / (1000 + 4000.0 / 3);
+    CHECK_CLOSE(circuit.getComponentCurrent("R1"), (10 - v2) / 1000, 1e-12);
+    CHECK_CLOSE(circuit.getComponentCurrent("R2"), v2 / 2000, 1e-12);
+    CHECK_CLOSE(circuit.getComponentCurrent("R3"), v2 / 4000, 1e-12);
+    const NameTable& names = circuit.getSnapshot()->netlist->names;
+    for (int id = 0; id < 4; ++id) CHECK(names.find(names.name(id)) == id);
+    CHECK(circuit.getComponentCurrent(2) == circuit.getComponentCurrent("R2"));
+
+    CHECK(circuit.removeElement("R2"));
+    CHECK(circuit.setupAndSolveMNA(0, 0));
+    const CompactNetlist& netlist = *circuit.getSnapshot()->netlist;
+    CHECK(netlist.size() == 3);
+    CHECK(netlist.find("R2") == -1);
+    CHECK(netlist.find("R3") == 2);
+    CHECK_CLOSE(circuit.getComponentCurrent("R3"), 8.0 / 4000, 1e-12);
+    CHECK(circuit.getComponentCurrent(2) == circuit.getComponentCurrent("R3"));
+    CHECK_CLOSE(circuit.getComponentCurrent("R1"), 2.0 / 1000, 1e-12);
+}
+
+// User node numbers map to compact indices kept up to date on every edit; a
+// circuit drawn on nodes 7, 42 and 1000 must solve exactly like the same
+// circuit on nodes 1, 2 and 3.
+TEST_CASE(nodes_renumber_densely) {
+    NodeNumbering numbering;
+    for (int node : {7, 42, 0, 1000, 42}) numbering.addReference(node);
+    CHECK(numbering.size() == 3);
+    CHECK(numbering.hasGround());
+    CHECK(numbering.indexOf(7) == 0 && numbering.indexOf(42) == 1 && numbering.indexOf(1000) == 2);
+    CHECK(numbering.indexOf(0) == -1 && numbering.indexOf(8) == -1);
+    numbering.removeReference(42);
+    CHECK(numbering.contains(42));
+    // The last node fills the freed index.
+    numbering.removeReference(7);
+    CHECK(!numbering.contains(7));
+    CHECK(numbering.size() == 2);
+    CHECK(numbering.indexOf(1000) == 0 && numbering.indexOf(42) == 1);
+    numbering.rename(1000, 5);
+    CHECK(numbering.indexOf(5) == 0 && numbering.indexOf(1000) == -1);
+    CHECK((numbering.getNodeNumbers() == vector<int>{5, 42}));
+
+    auto build = [](Circuit& circuit, int a, int b, int c) {
+        circuit.addElement(make_unique<VoltageSource>("V1", 9, a, 0));
+        circuit.addElement(make_unique<Resistor>("R1", 1000, a, b));
+        circuit.addElement(make_unique<Resistor>("R2", 2000, b, c));
+        circuit.addElement(make_unique<Resistor>("R3", 3000, c, 0));
+        circuit.addElement(make_unique<CurrentSource>("I1", 1e-3, 0, b));
+    };
+    Circuit compact, spread;
+    build(compact, 1, 2, 3);
+    build(spread, 7, 42, 1000);
+    SimulationContext compactRun(compact.getSnapshot()), spreadRun(spread.getSnapshot());
+    CHECK(compactRun.solveStep(0, 0) && spreadRun.solveStep(0, 0));
+    CHECK(spreadRun.size() == compactRun.size());
+    // Node 2: (9 V / 1k + 1 mA) / (1 / 1k + 1 / 5k) = 25 / 3 V.
+    CHECK_CLOSE(nodeVoltage(compactRun, 2), 25.0 / 3, 1e-12);
+    CHECK_CLOSE(nodeVoltage(compactRun, 3), 5.0, 1e-12);
+    CHECK(nodeVoltage(spreadRun, 7) == nodeVoltage(compactRun, 1));
+    CHECK(nodeVoltage(spreadRun, 42) == nodeVoltage(compactRun, 2));
+    CHECK(nodeVoltage(spreadRun, 1000) == nodeVoltage(compactRun, 3));
+
+    CHECK(spread.renameNode(1000, 3));
+    SimulationContext renamedRun(spread.getSnapshot());
+    CHECK(renamedRun.solveStep(0, 0));
+    CHECK((renamedRun.getProgram().nodeNumbers == vector<int>{7, 42, 3}));
+    CHECK(nodeVoltage(renamedRun, 3) == nodeVoltage(compactRun, 3));
+    CHECK(nodeVoltage(renamedRun, 1000) == 0.0);
+}
+
+// Each step swaps the two solution buffers instead of copying them: the last
+// solution becomes the history the next step reads, in the same storage.
+// I1 = 1 mA into R1 = 1k || C1 = 1 uF from rest, backward Euler with
+// h = 0.1 ms: v[n + 1] = (C / h v[n] + 1 mA) / (1 / R + C / h).
+TEST_CASE(solution_buffers_swap_per_step) {
+    Circuit circuit;
+    circuit.addElement(make_unique<CurrentSource>("I1", 1e-3, 0, 1));
+    circuit.addElement(make_unique<Resistor>("R1", 1000, 1, 0));
+    circuit.addElement(make_unique<Capacitor>("C1", 1e-6, 1, 0));
+    SimulationContext run(circuit.getSnapshot());
+    int capacitor = run.getSnapshot().netlist->find("C1");
+    double h = 1e-4, expected = 0.0;
+    CHECK(run.solveStep(0, h));
+    const double* buffers[2] = {run.solution.data(), run.previousSolution.data()};
+    for (int step = 1; step <= 4; ++step) {
+        double previous = expected;
+        expected = (1e-2 * expected + 1e-3) / 1.1e-2;
+        if (step > 1) CHECK(run.solveStep((step - 1) * h, h));
+        CHECK(run.solutionValid);
+        CHECK(run.solutionTime == (step - 1) * h);
+        CHECK_CLOSE(run.solution(0), expected, 1e-12);
+        CHECK_CLOSE(run.previousSolution(0), previous, 1e-12);
+        CHECK_CLOSE(run.componentCurrent(capacitor), 1e-3 - expected / 1000, 1e-9);
+        CHECK(run.solution.data() == buffers[(step - 1) % 2]);
+    }
+}
+
+// In debug builds Eigen asserts on any heap allocation made while a
+// NoHeapAllocationScope is armed, so a dense transient that reaches the end
+// with the right values never allocated inside its steps. V1 = 1 V charges
+// C1 = 1 uF through R1 = 1k.
+TEST_CASE(dense_steps_run_without_allocation) {
+#ifdef EIGEN_RUNTIME_NO_MALLOC
+    CHECK(Eigen::internal::is_malloc_allowed());
+    {
+        NoHeapAllocationScope noAllocation;
+        CHECK(!Eigen::internal::is_malloc_allowed());
+        {
+            NoHeapAllocationScope nested;
+            CHECK(!Eigen::internal::is_malloc_allowed());
+        }
+        CHECK(!Eigen::internal::is_malloc_allowed());
+    }
+    CHECK(Eigen::internal::is_malloc_allowed());
+    {
+        NoHeapAllocationScope disabled(false);
+        CHECK(Eigen::internal::is_malloc_allowed());
+    }
+    {
+        // A second analysis in flight may allocate, so the guard stays off.
+        NoHeapAllocationScope::Analysis first, second;
+        NoHeapAllocationScope noAllocation;
+        CHECK(Eigen::internal::is_malloc_allowed());
+    }
+#endif
+
+    Circuit circuit;
+    circuit.addElement(make_unique<VoltageSource>("V1", 1, 1, 0));
+    circuit.addElement(make_unique<Resistor>("R1", 1000, 1, 2));
+    circuit.addElement(make_unique<Capacitor>("C1", 1e-6, 2, 0));
+    SimulationContext run(circuit.getSnapshot());
+    CHECK(run.stepsWithoutAllocation());
+
+    // Backward Euler with h = 0.1 ms: v[n + 1] = (v[n] + h / RC) / (1 + h / RC).
+    RecordingSink sink;
+    ostringstream log;
+    CHECK(circuit.computeTransient(0, 9.5e-4, 1e-4, sink, log));
+    CHECK(sink.rows.size() == 10);
+    int node2 = sink.column("V(node 2)");
+    double v = 0.0;
+    for (size_t row = 0; row < sink.rows.size(); ++row) {
+        v = (v + 0.1) / 1.1;
+        CHECK_CLOSE(sink.rows[row](node2), v, 1e-12);
+        CHECK_CLOSE(sink.rows[row](sink.column("I(V1)")), -(1 - v) / 1000, 1e-9);
+    }
+
+    // The adaptive stepper guards its trial and accepted steps the same way.
+    TransientOptions options;
+    options.adaptive = true;
+    options.relativeTolerance = 1e-4;
+    options.absoluteTolerance = 1e-7;
+    circuit.setTransientOptions(options);
+    RecordingSink adaptive;
+    CHECK(circuit.computeTransient(0, 5e-3, 1e-3, adaptive, log));
+    CHECK(adaptive.rows.size() == 6);
+    for (size_t row = 1; row < adaptive.rows.size(); ++row) {
+        CHECK_CLOSE(adaptive.rows[row](node2), 1 - exp(-adaptive.times[row] / 1e-3), 1e-2);
+    }
+}
+
+// The matrix depends only on element values and the step size; within a run
+// each step rebuilds just the source and companion history entries of the
+// right-hand side. V1 = sin(2 pi 250 t) drives R1 = 1k into node 2, which has
+// R2 = 1k and C1 = 1 uF to ground and I1 = 1 mA into it, so
+// v2 = (v1 / R + 1 mA + C / h v2_prev) / (2 / R + C / h).
+TEST_CASE(steps_update_only_time_varying_entries) {
+    Circuit circuit;
+    circuit.addElement(make_unique<VoltageSource>("V1", 0, 1, 250, 1, 0));
+    circuit.addElement(make_unique<Resistor>("R1", 1000, 1, 2));
+    circuit.addElement(make_unique<Resistor>("R2", 1000, 2, 0));
+    circuit.addElement(make_unique<Capacitor>("C1", 1e-6, 2, 0));
+    circuit.addElement(make_unique<CurrentSource>("I1", 1e-3, 0, 2));
+    shared_ptr<const NetlistSnapshot> snapshot = circuit.getSnapshot();
+    CHECK(snapshot->program.sourceStamps.size() == 2);
+
+    // DC: the capacitor is open, v2 = (v1 / R + 1 mA) / (2 / R).
+    SimulationContext dc(snapshot);
+    for (double t : {0.0, 1e-3, 2.5e-3}) {
+        CHECK(dc.solveStep(t, 0));
+        double v1 = sin(2 * M_PI * 250 * t);
+        CHECK_CLOSE(nodeVoltage(dc, 1), v1, 1e-12);
+        CHECK_CLOSE(nodeVoltage(dc, 2), (v1 + 1) / 2, 1e-6);
+    }
+
+    SimulationContext run(snapshot);
+    double h = 1e-4, v2 = 0.0;
+    for (int step = 0; step < 40; ++step) {
+        double t = step * h;
+        CHECK(run.solveStep(t, h));
+        double v1 = sin(2 * M_PI * 250 * t);
+        v2 = (v1 / 1000 + 1e-3 + 1e-2 * v2) / (2e-3 + 1e-2);
+        if (step % 7 == 0) {
+            CHECK_CLOSE(nodeVoltage(run, 1), v1, 1e-9);
+            CHECK_CLOSE(nodeVoltage(run, 2), v2, 1e-9);
+        }
+    }
+    // A new source waveform changes only the right-hand side as well.
+    run.setSource(snapshot->netlist->find("V1"), 2, 0, 0);
+    CHECK(run.solveStep(40 * h, h));
+    v2 = (2e-3 + 1e-3 + 1e-2 * v2) / (2e-3 + 1e-2);
+    CHECK_CLOSE(nodeVoltage(run, 1), 2, 1e-12);
+    CHECK_CLOSE(nodeVoltage(run, 2), v2, 1e-9);
+}
+
+// A snapshot's program never changes once built: contexts keep their value
+// overrides to themselves, circuit edits make a new snapshot, and threads each
+// running a context on one snapshot do not see each other. V1 = 10 V across R1 = 1k in
+// series with R2, so v2 = 10 R2 / (1k + R2).
+TEST_CASE(contexts_share_an_immutable_snapshot) {
+    Circuit circuit;
+    circuit.addElement(make_unique<VoltageSource>("V1", 10, 1, 0));
+    circuit.addElement(make_unique<Resistor>("R1", 1000, 1, 2));
+    circuit.addElement(make_unique<Resistor>("R2", 1000, 2, 0));
+    shared_ptr<const NetlistSnapshot> snapshot = circuit.getSnapshot();
+    CHECK(circuit.getSnapshot() == snapshot);
+    int r2 = snapshot->netlist->find("R2");
+
+    SimulationContext edited(snapshot), untouched(snapshot);
+    edited.setElementValue(r2, 3000);
+    CHECK(edited.solveStep(0, 0) && untouched.solveStep(0, 0));
+    CHECK_CLOSE(nodeVoltage(edited, 2), 7.5, 1e-12);
+    CHECK_CLOSE(nodeVoltage(untouched, 2), 5.0, 1e-12);
+    CHECK(snapshot->program.elementValues[2] == 1000);
+
+    CHECK(circuit.setElementParameter("R2", ElementParameter::VALUE, 4000));
+    shared_ptr<const NetlistSnapshot> next = circuit.getSnapshot();
+    CHECK(next != snapshot);
+    CHECK(snapshot->program.elementValues[2] == 1000);
+    CHECK(next->program.elementValues[2] == 4000);
+    SimulationContext before(snapshot), after(next);
+    CHECK(before.solveStep(0, 0) && after.solveStep(0, 0));
+    CHECK_CLOSE(nodeVoltage(before, 2), 5.0, 1e-12);
+    CHECK_CLOSE(nodeVoltage(after, 2), 8.0, 1e-12);
+
+    const int threadCount = 8;
+    vector<double> results(threadCount);
+    vector<thread> threads;
+    for (int k = 0; k < threadCount; ++k) {
+        threads.emplace_back([&, k] {
+            SimulationContext run(snapshot);
+            for (int repeat = 0; repeat < 200; ++repeat) {
+                run.setElementValue(r2, 1000.0 * (k + 1 + repeat % 3));
+                run.solveStep(0, 0);
+            }
+            run.setElementValue(r2, 1000.0 * (k + 1));
+            results[k] = run.solveStep(0, 0) ? nodeVoltage(run, 2) : -1.0;
+        });
+    }
+    for (thread& t : threads) t.join();
+    for (int k = 0; k < threadCount; ++k) CHECK_CLOSE(results[k], 10.0 * (k + 1) / (k + 2), 1e-12);
+    CHECK(snapshot->program.elementValues[2] == 1000);
+}
+
+// parallelFor hands every index to exactly one chunk, nested loops included,
+// and rethrows a chunk's exception after the rest has stopped; submit carries
+// a task's exception back through its future; the metrics hook sees every
+// outermost loop. A sweep on four workers matches one on a single worker.
+TEST_CASE(thread_pool_covers_and_propagates) {
+    ThreadPoolOptions options;
+    options.threadCount = 4;
+    ThreadPool pool(options);
+    CHECK(pool.size() == 4);
+    int hookCalls = 0;
+    ThreadPoolMetrics last;
+    pool.setMetricsHook([&](const ThreadPoolMetrics& m) {
+        ++hookCalls;
+        last = m;
+    });
+
+    const int count = 10007;
+    vector<atomic<int>> hits(count);
+    atomic<int> chunks{0};
+    pool.parallelFor(count, 64, [&](int begin, int end) {
+        CHECK(end - begin <= 64 && begin % 64 == 0);
+        ++chunks;
+        for (int i = begin; i < end; ++i) hits[i].fetch_add(1);
+    });
+    CHECK(chunks == (count + 63) / 64);
+    CHECK(all_of(hits.begin(), hits.end(), [](const atomic<int>& h) { return h == 1; }));
+    CHECK(hookCalls == 1);
+    CHECK(last.threads == 4);
+    CHECK(last.tasksExecuted >= chunks);
+
+    vector<atomic<int>> grid(16 * 100);
+    pool.parallelFor(16, 1, [&](int outer, int) {
+        pool.parallelFor(100, 8, [&](int begin, int end) {
+            for (int i = begin; i < end; ++i) grid[outer * 100 + i].fetch_add(1);
+        });
+    });
+    CHECK(all_of(grid.begin(), grid.end(), [](const atomic<int>& h) { return h == 1; }));
+    CHECK(hookCalls == 2);
+    pool.parallelFor(0, 1, [&](int, int) { CHECK(false); });
+
+    string caught;
+    try {
+        pool.parallelFor(1000, 10, [](int begin, int) {
+            if (begin == 500) throw runtime_error("chunk 50");
+        });
+    } catch (const runtime_error& e) {
+        caught = e.what();
+    }
+    CHECK(caught == "chunk 50");
+    atomic<int> afterFailure{0};
+    pool.parallelFor(100, 1, [&](int, int) { ++afterFailure; });
+    CHECK(afterFailure == 100);
+    CHECK(hookCalls == 4);
+
+    atomic<bool> ran{false};
+    future<void> done = pool.submit([&] { ran = true; });
+    done.get();
+    CHECK(ran);
+    future<void> failing = pool.submit([] { throw invalid_argument("task"); });
+    caught.clear();
+    try {
+        failing.get();
+    } catch (const invalid_argument& e) {
+        caught = e.what();
+    }
+    CHECK(caught == "task");
+    CHECK(pool.metrics().tasksExecuted >= last.tasksExecuted + 2);
+
+    // V1 drives node 2 through R1 = 1k, R2 = 1k holds it to ground and I1
+    // feeds it: v2 = (V1 + 1k I1) / 2.
+    Circuit circuit;
+    circuit.addElement(make_unique<VoltageSource>("V1", 0, 1, 0));
+    circuit.addElement(make_unique<Resistor>("R1", 1000, 1, 2));
+    circuit.addElement(make_unique<Resistor>("R2", 1000, 2, 0));
+    circuit.addElement(make_unique<CurrentSource>("I1", 0, 0, 2));
+    vector<SweepAxis> axes = {{"V1", 0, 4, 1}, {"I1", 0, 2e-3, 5e-4}};
+    ThreadPoolOptions serialOptions;
+    serialOptions.threadCount = 1;
+    ThreadPool serial(serialOptions);
+    SweepResult parallelResult, serialResult;
+    CHECK(circuit.sweepSources(axes, {"V(2)", "I(R2)"}, parallelResult, pool));
+    CHECK(circuit.sweepSources(axes, {"V(2)", "I(R2)"}, serialResult, serial));
+    CHECK(parallelResult.values.rows() == 25 && parallelResult.values.cols() == 2);
+    CHECK(parallelResult.values == serialResult.values);
+    CHECK(parallelResult.sourceValues == serialResult.sourceValues);
+    for (int row = 0; row < parallelResult.values.rows(); ++row) {
+        double v2 = (parallelResult.sourceValues(row, 0) + 1000 * parallelResult.sourceValues(row, 1)) / 2;
+        CHECK_CLOSE(parallelResult.values(row, 0), v2, 1e-12);
+        CHECK_CLOSE(parallelResult.values(row, 1), v2 / 1000, 1e-12);
+    }
+}
+
+// Above PARALLEL_ASSEMBLY_THRESHOLD stamps, with more than one worker, the
+// pattern is built and the values summed on the pool. Each nonzero must still
+// be the sum of its stamps in stamp order, so the factorization and the
+// solution equal bit for bit those of the serial assembly, redone here as the
+// serial path does it. ctest runs this with CIRCUIT_THREADS=4.
+TEST_CASE(parallel_assembly_matches_serial) {
+    CHECK(ThreadPool::shared().size() > 1);
+    int sections = 60000;
+    Circuit circuit;
+    buildLadder(circuit, sections);
+    for (int node = 1; node <= sections + 1; ++node) {
+        circuit.addElement(make_unique<Capacitor>("C" + to_string(node), 1e-6, node, 0));
+    }
+    shared_ptr<const NetlistSnapshot> snapshot = circuit.getSnapshot();
+    const StampProgram& program = snapshot->program;
+    CHECK((int)program.matrixStamps.size() >= PARALLEL_ASSEMBLY_THRESHOLD);
+    int n = program.size();
+
+    vector<Eigen::Triplet<double>> pattern;
+    for (const auto& s : program.matrixStamps) pattern.emplace_back(s.row, s.col, 0.0);
+    Eigen::SparseMatrix<double> matrix(n, n);
+    matrix.setFromTriplets(pattern.begin(), pattern.end());
+    matrix.makeCompressed();
+    SparseSolver lu;
+    lu.analyzePattern(matrix);
+    Eigen::VectorXd rhs = Eigen::VectorXd::Zero(n);
+    rhs(0) = 1e-3;
+
+    SimulationContext run(snapshot);
+    // A step from rest and then a DC solve: both only see the source current.
+    for (double timeStep : {1e-5, 0.0}) {
+        double* values = matrix.valuePtr();
+        fill(values, values + matrix.nonZeros(), 0.0);
+        for (const auto& s : program.matrixStamps) {
+            values[&matrix.coeffRef(s.row, s.col) - values] +=
+                s.sign * program.coefficientFor(s.slot, program.elementValues[s.slot], timeStep);
+        }
+        lu.factorize(matrix);
+        CHECK(lu.info() == Eigen::Success);
+        Eigen::VectorXd serial = lu.solve(rhs);
+
+        long long tasksBefore = ThreadPool::shared().metrics().tasksExecuted;
+        CHECK(run.solveStep(0, timeStep));
+        CHECK(ThreadPool::shared().metrics().tasksExecuted > tasksBefore);
+        int mismatches = 0;
+        for (int k = 0; k < n; ++k) mismatches += run.solution(k) != serial(k);
+        CHECK(mismatches == 0);
+    }
+    // At DC the capacitors are all but open, so the source current leaves
+    // through the shunts, and the first series resistor carries all of it
+    // but the first shunt's share.
+    double shunts = 0.0;
+    for (int node = 1; node <= sections + 1; ++node) shunts += nodeVoltage(run, node) / 1000;
+    CHECK_CLOSE(shunts, 1e-3, 1e-6);
+    CHECK_CLOSE((nodeVoltage(run, 1) - nodeVoltage(run, 2)) / 100, 1e-3 - nodeVoltage(run, 1) / 1000, 1e-6);
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2 || !registry().count(argv[1])) {
+        cerr << "Usage: engine_tests <test>; tests:";
+        for (const auto& [name, test] : registry()) cerr << " " << name;
+        cerr << endl;
+        return 2;
+    }
+    registry()[argv[1]]();
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,23 @@
+# Feeds INPUT to the simulator's menu and checks that it exits cleanly and
+# prints every line of EXPECT_FILE, in that order. Run from the tests
+# directory so circuit files load by name.
+execute_process(COMMAND ${PROGRAM}
+                INPUT_FILE ${INPUT}
+                OUTPUT_VARIABLE output
+                ERROR_VARIABLE output
+                RESULT_VARIABLE result
+                TIMEOUT 60)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "Simulator exited with '${result}':\n${output}")
+endif()
+file(STRINGS ${EXPECT_FILE} expected_lines)
+set(rest "${output}")
+foreach(expected IN LISTS expected_lines)
+    string(FIND "${rest}" "${expected}" found)
+    if(found EQUAL -1)
+        message(FATAL_ERROR "Expected '${expected}' after the earlier expected lines in the output:\n${output}")
+    endif()
+    string(LENGTH "${expected}" length)
+    math(EXPR found "${found} + ${length}")
+    string(SUBSTRING "${rest}" ${found} -1 rest)
+endforeach()